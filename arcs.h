@@ -0,0 +1,259 @@
+//arc geometry for whole batches of arcs at once: radius, sweep and start angle from the start, end and center,
+//four arcs at a time with SSE where the compiler targets it, one at a time otherwise
+//arc_check holds both to the float acos math the parser had before for arcs of up to half a circle,
+//and to a double precision reference built on libm for the longer ones and full circles, which that math got wrong
+#ifndef ARCS_H
+#define ARCS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#define ARC_FULL_CIRCLE 1e-5f	//an arc that ends closer than this times its radius to its start is a full circle
+#define ARC_RADIUS_TOLERANCE 0.01f	//start and end radius may differ by this much before the arc gets reported
+#define ARC_CHECK_TOLERANCE 1e-3f	//degrees and drawing units arc_check accepts
+#define ARC_BASELINE_ERROR 2e-5	//how far the cosine the old acos math took can be off, two Newton steps of Q_rsqrt on each radius
+#define ARC_PI 3.14159265358979323846
+
+//inputs and outputs as one array per field, xy only, the z of a helix does not change its shape
+typedef struct ArcBatch{
+	float *sx, *sy;	//start
+	float *ex, *ey;	//end
+	float *cx, *cy;	//center
+	float *dir;	//1 for G3 (counterclockwise), -1 for G2
+	float *radius;
+	float *angle;	//sweep in degrees, negative for G2, +-360 for a full circle
+	float *offset;	//start angle, the way arc_point counts it
+	float *mismatch;	//difference between the start and the end radius
+	int cap;
+}ArcBatch;
+
+void arc_batch_reserve(ArcBatch *b, int count){
+	if(count <= b->cap) return;
+	b->cap = count*2;
+	float *mem = (float *)realloc(b->sx, sizeof(float)*11*b->cap);
+	if(mem == NULL){
+		perror("Could not allocate space for the arcs!");
+		exit(-1);
+	}
+	float **fields[] = {&b->sx, &b->sy, &b->ex, &b->ey, &b->cx, &b->cy, &b->dir, &b->radius, &b->angle, &b->offset, &b->mismatch};
+	for(int i=0; i<11; i++) *fields[i] = mem + i*b->cap;
+}
+
+void arc_batch_free(ArcBatch *b){
+	free(b->sx);
+	*b = (ArcBatch){0};
+}
+
+//atan on [0, 1], Abramowitz and Stegun 4.4.49, within 1e-5 radians
+#define ARC_ATAN_POLY(t, t2) ((t)*(0.9998660f + (t2)*(-0.3302995f + (t2)*(0.1801410f + (t2)*(-0.0851330f + (t2)*0.0208351f)))))
+
+static inline float arc_atan2(float y, float x){
+	float ax = fabsf(x), ay = fabsf(y);
+	float hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+	float t = hi > 0 ? lo/hi : 0;
+	float r = ARC_ATAN_POLY(t, t*t);
+	if(ay > ax) r = PI/2 - r;
+	if(x < 0) r = PI - r;
+	return y < 0 ? -r : r;
+}
+
+static void arc_resolve_scalar(ArcBatch *b, int first, int count){
+	for(int i=first; i<first + count; i++){
+		float vx = b->sx[i] - b->cx[i], vy = b->sy[i] - b->cy[i];
+		float ux = b->ex[i] - b->cx[i], uy = b->ey[i] - b->cy[i];
+		float rv = sqrtf(vx*vx + vy*vy), ru = sqrtf(ux*ux + uy*uy);
+		float chord2 = (ux - vx)*(ux - vx) + (uy - vy)*(uy - vy);
+
+		float a = arc_atan2(vx*uy - vy*ux, vx*ux + vy*uy)*RAD2DEG;
+		if(b->dir[i] > 0 && a <= 0) a += 360;
+		if(b->dir[i] < 0 && a >= 0) a -= 360;
+		if(chord2 <= ARC_FULL_CIRCLE*ARC_FULL_CIRCLE*rv*rv) a = 360*b->dir[i];
+
+		b->radius[i] = rv;
+		b->angle[i] = a;
+		b->offset[i] = arc_atan2(vx, vy)*RAD2DEG - (b->dir[i] > 0 ? 180 : 0);
+		b->mismatch[i] = fabsf(rv - ru);
+	}
+}
+
+#if defined(__SSE2__)
+static inline __m128 arc_select_ps(__m128 mask, __m128 a, __m128 b){
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 arc_atan2_ps(__m128 y, __m128 x){
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y);
+	__m128 hi = _mm_max_ps(ax, ay), lo = _mm_min_ps(ax, ay);
+	__m128 t = _mm_div_ps(lo, _mm_max_ps(hi, _mm_set1_ps(1e-30f)));
+	__m128 t2 = _mm_mul_ps(t, t);
+
+	__m128 r = _mm_set1_ps(0.0208351f);
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(-0.0851330f));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(0.1801410f));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(-0.3302995f));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(0.9998660f));
+	r = _mm_mul_ps(r, t);
+
+	r = arc_select_ps(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(PI/2), r), r);
+	r = arc_select_ps(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), r), r);
+	return _mm_or_ps(r, _mm_and_ps(sign, y));	//r is never negative here, so y lends it its sign
+}
+
+static void arc_resolve_sse(ArcBatch *b, int count){
+	const __m128 zero = _mm_setzero_ps(), full = _mm_set1_ps(360.0f), deg = _mm_set1_ps(RAD2DEG);
+	const __m128 sign = _mm_set1_ps(-0.0f), tol2 = _mm_set1_ps(ARC_FULL_CIRCLE*ARC_FULL_CIRCLE);
+	for(int i=0; i<count; i += 4){
+		__m128 cx = _mm_loadu_ps(b->cx + i), cy = _mm_loadu_ps(b->cy + i);
+		__m128 vx = _mm_sub_ps(_mm_loadu_ps(b->sx + i), cx), vy = _mm_sub_ps(_mm_loadu_ps(b->sy + i), cy);
+		__m128 ux = _mm_sub_ps(_mm_loadu_ps(b->ex + i), cx), uy = _mm_sub_ps(_mm_loadu_ps(b->ey + i), cy);
+		__m128 dir = _mm_loadu_ps(b->dir + i);
+
+		__m128 rv2 = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy));
+		__m128 rv = _mm_sqrt_ps(rv2);
+		__m128 ru = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)));
+		__m128 dx = _mm_sub_ps(ux, vx), dy = _mm_sub_ps(uy, vy);
+		__m128 chord2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+		__m128 cross = _mm_sub_ps(_mm_mul_ps(vx, uy), _mm_mul_ps(vy, ux));
+		__m128 dot = _mm_add_ps(_mm_mul_ps(vx, ux), _mm_mul_ps(vy, uy));
+		__m128 a = _mm_mul_ps(arc_atan2_ps(cross, dot), deg);
+		__m128 ccw = _mm_cmpgt_ps(dir, zero);
+		a = _mm_add_ps(a, _mm_and_ps(_mm_and_ps(ccw, _mm_cmple_ps(a, zero)), full));
+		a = _mm_sub_ps(a, _mm_and_ps(_mm_andnot_ps(ccw, _mm_cmpge_ps(a, zero)), full));
+		a = arc_select_ps(_mm_cmple_ps(chord2, _mm_mul_ps(tol2, rv2)), _mm_mul_ps(full, dir), a);
+
+		__m128 offset = _mm_sub_ps(_mm_mul_ps(arc_atan2_ps(vx, vy), deg), _mm_and_ps(ccw, _mm_set1_ps(180.0f)));
+
+		_mm_storeu_ps(b->radius + i, rv);
+		_mm_storeu_ps(b->angle + i, a);
+		_mm_storeu_ps(b->offset + i, offset);
+		_mm_storeu_ps(b->mismatch + i, _mm_andnot_ps(sign, _mm_sub_ps(rv, ru)));
+	}
+}
+#endif
+
+//fill in radius, angle, offset and mismatch for the first count arcs
+void arc_resolve(ArcBatch *b, int count){
+#if defined(__SSE2__)
+	int wide = count & ~3;
+	arc_resolve_sse(b, wide);
+	arc_resolve_scalar(b, wide, count - wide);
+#else
+	arc_resolve_scalar(b, 0, count);
+#endif
+}
+
+//the same geometry in double precision with libm, what arc_check holds the batch to
+static void arc_resolve_reference(ArcBatch *b, int i, double *radius, double *angle, double *offset){
+	double vx = (double)b->sx[i] - b->cx[i], vy = (double)b->sy[i] - b->cy[i];
+	double ux = (double)b->ex[i] - b->cx[i], uy = (double)b->ey[i] - b->cy[i];
+	double chord2 = (ux - vx)*(ux - vx) + (uy - vy)*(uy - vy);
+
+	*radius = sqrt(vx*vx + vy*vy);
+	*angle = atan2(vx*uy - vy*ux, vx*ux + vy*uy)*180.0/ARC_PI;
+	if(b->dir[i] > 0 && *angle <= 0) *angle += 360;
+	if(b->dir[i] < 0 && *angle >= 0) *angle -= 360;
+	if(chord2 <= (double)ARC_FULL_CIRCLE*ARC_FULL_CIRCLE*(vx*vx + vy*vy)) *angle = 360*b->dir[i];
+	*offset = atan2(vx, vy)*180.0/ARC_PI - (b->dir[i] > 0 ? 180 : 0);
+}
+
+float Q_rsqrt(float number);	//util.h
+
+//the float acos geometry the parser used before the batches, kept so arc_check can hold arcs of up to half a circle to it,
+//longer ones folded back through acos and full circles needed the exact same end, those are checked against the reference only
+static void arc_resolve_baseline(ArcBatch *b, int i, float *radius, float *angle, float *offset){
+	float vx = b->sx[i] - b->cx[i], vy = b->sy[i] - b->cy[i];
+	float ux = b->ex[i] - b->cx[i], uy = b->ey[i] - b->cy[i];
+	*radius = 1.0f / Q_rsqrt(vx*vx + vy*vy);
+
+	float mag_v = 1.0f / Q_rsqrt(vx*vx + vy*vy);
+	float mag_u = 1.0f / Q_rsqrt(ux*ux + uy*uy);
+	*angle = RAD2DEG*acos((vx*ux + vy*uy) / (mag_v * mag_u));
+	*offset = atan2(vx, vy)*RAD2DEG -180;
+	if(b->dir[i] < 0){
+		*angle = -*angle;
+		*offset = *offset+180;
+	}
+}
+
+//add count made up arcs after the first `first`: all sizes, directions and sweeps, a few full circles and a few
+//barely there, anywhere on a large table, returns the new total
+int arc_batch_random(ArcBatch *b, int first, int count){
+	arc_batch_reserve(b, first + count);
+	srand(1);
+	for(int i=first; i<first + count; i++){
+		float r = powf(10.0f, -3.0f + 5.7f*rand()/(float)RAND_MAX);	//0.001 to 500
+		float start = 360.0f*rand()/(float)RAND_MAX;
+		float sweep = (720.0f*rand()/(float)RAND_MAX - 360.0f);
+		if(i % 50 == 0) sweep = sweep < 0 ? -360 : 360;
+		if(i % 50 == 1) sweep = sweep < 0 ? -0.05f : 0.05f;
+		b->cx[i] = 2000.0f*rand()/(float)RAND_MAX - 1000.0f;
+		b->cy[i] = 2000.0f*rand()/(float)RAND_MAX - 1000.0f;
+		b->sx[i] = b->cx[i] + r*cosf(DEG2RAD*start);
+		b->sy[i] = b->cy[i] + r*sinf(DEG2RAD*start);
+		b->ex[i] = b->cx[i] + r*cosf(DEG2RAD*(start + sweep));
+		b->ey[i] = b->cy[i] + r*sinf(DEG2RAD*(start + sweep));
+		b->dir[i] = sweep < 0 ? -1 : 1;
+	}
+	return first + count;
+}
+
+//difference between two angles in degrees, ignoring whole turns
+static double arc_angle_error(double a, double b){
+	double d = fmod(fabs(a - b), 360.0);
+	return d > 180 ? 360 - d : d;
+}
+
+//resolve count arcs already in b and compare them with the old acos math, or the reference where that was wrong on purpose,
+//prints the worst errors, true if everything is within ARC_CHECK_TOLERANCE (degrees for angles, relative for the radius)
+//plus what the old math itself could be off by
+bool arc_check(ArcBatch *b, int count){
+	arc_resolve(b, count);
+
+	double worst_radius = 0, worst_angle = 0, worst_old_angle = 0, worst_offset = 0;	//the sweep against the reference and the old math
+	int bad = 0, against_baseline = 0;
+	for(int i=0; i<count; i++){
+		double radius, angle, offset;
+		arc_resolve_reference(b, i, &radius, &angle, &offset);
+		double angle_tolerance = ARC_CHECK_TOLERANCE;
+
+		//the sweep of an arc with the same start and end depends on rounding, a full circle or almost nothing
+		bool borderline = fabs(fabs(angle) - 360) < 1e-2 || fabs(angle) < 1e-2;
+		bool old = false;
+		float old_radius, old_angle, old_offset;
+		arc_resolve_baseline(b, i, &old_radius, &old_angle, &old_offset);
+		if(fabs(angle) < 180 && !borderline && !isnan(old_angle)){
+			//acos only knows the cosine to within the error of Q_rsqrt, worst near 0 and 180 degrees
+			double sine = sin(fabs(angle)*ARC_PI/180.0);
+			angle_tolerance += 180.0/ARC_PI*fmin(ARC_BASELINE_ERROR/fmax(sine, 1e-9), sqrt(2*ARC_BASELINE_ERROR));
+			radius = old_radius;
+			angle = old_angle;
+			offset = old_offset;
+			against_baseline++;
+			old = true;
+		}
+
+		double e_radius = fabs(b->radius[i] - radius)/(radius > 1 ? radius : 1);
+		double e_angle = fabs(b->angle[i] - angle);	//a sweep of 360 is not the same as 0
+		double e_offset = arc_angle_error(b->offset[i], offset);
+		if(borderline) e_angle = arc_angle_error(b->angle[i], angle);
+
+		if(e_radius > ARC_CHECK_TOLERANCE || e_angle > angle_tolerance || e_offset > ARC_CHECK_TOLERANCE){
+			if(bad++ < 5) printf("Arc %d: radius %g/%g angle %g/%g offset %g/%g\n", i, b->radius[i], radius, b->angle[i], angle, b->offset[i], offset);
+		}
+		worst_radius = fmax(worst_radius, e_radius);
+		if(old) worst_old_angle = fmax(worst_old_angle, e_angle);
+		else worst_angle = fmax(worst_angle, e_angle);
+		worst_offset = fmax(worst_offset, e_offset);
+	}
+	printf("%d arcs, %d under half a circle held to the old math, worst radius error %.2g, sweep %.2g deg (%.2g deg from the old math), start %.2g deg, %d outside the tolerance\n",
+			count, against_baseline, worst_radius, worst_angle, worst_old_angle, worst_offset, bad);
+	return bad == 0;
+}
+
+#endif //ARCS_H
@@ -0,0 +1,89 @@
+//coloring the paths by a value of each move instead of its type, done in the path shaders
+//so switching what to color by or the colormap is only a change of uniforms
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+#define COLORMAP_STOPS 9	//keep in sync with the path shaders
+
+enum{
+	COLOR_BY_TYPE,
+	COLOR_BY_FEED,
+	COLOR_BY_SPINDLE,
+	COLOR_BY_ORDER,	//segment number, how far into the program the move is
+	COLOR_BY_TIME,	//seconds from the start of the program to the end of the move, rapids at the rapid rate
+	COLOR_BY_Z,
+	COLOR_MODES
+};
+
+static const char *color_mode_names[COLOR_MODES] = {"type", "feed", "spindle", "order", "time", "z"};
+
+typedef struct ColormapDef{
+	const char *name;
+	Color stops[COLORMAP_STOPS];	//evenly spaced from the lowest value to the highest
+}ColormapDef;
+
+static const ColormapDef colormaps[] = {
+	{"viridis", {{68, 1, 84, 255}, {71, 45, 123, 255}, {59, 82, 139, 255}, {44, 114, 142, 255}, {33, 145, 140, 255},
+			{40, 174, 128, 255}, {94, 201, 98, 255}, {173, 220, 48, 255}, {253, 231, 37, 255}}},
+	{"turbo", {{48, 18, 59, 255}, {70, 98, 215, 255}, {54, 170, 249, 255}, {26, 228, 182, 255}, {114, 254, 94, 255},
+			{199, 239, 52, 255}, {250, 186, 57, 255}, {246, 107, 25, 255}, {122, 4, 3, 255}}},
+	{"inferno", {{0, 0, 4, 255}, {31, 12, 72, 255}, {85, 15, 109, 255}, {136, 34, 106, 255}, {186, 54, 85, 255},
+			{227, 89, 51, 255}, {249, 142, 9, 255}, {249, 203, 53, 255}, {252, 255, 164, 255}}},
+	{"coolwarm", {{59, 76, 192, 255}, {98, 130, 234, 255}, {141, 176, 254, 255}, {184, 208, 249, 255}, {221, 221, 221, 255},
+			{245, 196, 173, 255}, {244, 154, 123, 255}, {222, 96, 77, 255}, {180, 4, 38, 255}}},
+};
+#define COLORMAP_COUNT (int)(sizeof(colormaps)/sizeof(colormaps[0]))
+
+//what the paths are colored by this frame
+typedef struct PathColoring{
+	int mode;	//COLOR_BY_*
+	int colormap;	//index into colormaps
+	float min, max;	//values mapped to the ends of the colormap, the order always spans the whole path
+}PathColoring;
+
+//the stops as the vec3 array the shaders take
+static void colormap_uniform(int colormap, Vector3 *out){
+	for(int i=0; i<COLORMAP_STOPS; i++){
+		Vector4 c = ColorNormalize(colormaps[colormap].stops[i]);
+		out[i] = (Vector3){c.x, c.y, c.z};
+	}
+}
+
+//formats like 1h 02m or 3m 07s into buf
+static char *colormap_time(char *buf, float seconds){
+	if(seconds < 60) sprintf(buf, "%.1fs", seconds);
+	else if(seconds < 3600) sprintf(buf, "%dm %02ds", (int)(seconds/60), (int)fmodf(seconds, 60));
+	else sprintf(buf, "%dh %02dm", (int)(seconds/3600), (int)fmodf(seconds/60, 60));
+	return buf;
+}
+
+//color bar with the range it spans, above the selected line
+void DrawColorLegend(PathColoring *c, bool dark_mode){
+	if(c->mode == COLOR_BY_TYPE) return;
+
+	Color fg = dark_mode ? LIGHTGRAY : DARKGRAY;
+	int x = 10, y = GetScreenHeight() - 70, w = 24;
+	const Color *stops = colormaps[c->colormap].stops;
+	for(int i=0; i<COLORMAP_STOPS - 1; i++) DrawRectangleGradientH(x + i*w, y, w, 10, stops[i], stops[i + 1]);
+
+	int right = x + (COLORMAP_STOPS - 1)*w;
+	if(c->mode == COLOR_BY_ORDER){
+		DrawText("start", x, y + 14, 10, fg);
+		DrawText("end", right - MeasureText("end", 10), y + 14, 10, fg);
+	}
+	else if(c->mode == COLOR_BY_TIME){
+		char a[32], b[32];
+		DrawText(colormap_time(a, c->min), x, y + 14, 10, fg);
+		colormap_time(b, c->max);
+		DrawText(b, right - MeasureText(b, 10), y + 14, 10, fg);
+	}
+	else{
+		float unit = c->mode == COLOR_BY_Z ? 1.0f/scale : 1.0f;	//z is in drawing units, show it in program units
+		DrawText(TextFormat("%g", c->min*unit), x, y + 14, 10, fg);
+		const char *max = TextFormat("%g", c->max*unit);
+		DrawText(max, right - MeasureText(max, 10), y + 14, 10, fg);
+	}
+	DrawText(TextFormat("%s, %s", color_mode_names[c->mode], colormaps[c->colormap].name), right + 8, y, 10, fg);
+}
+
+#endif //COLORMAP_H
@@ -3,7 +3,17 @@
 CFLAGS=$(pkg-config --cflags raylib)
 LDFLAGS=$(pkg-config --libs raylib)
 
+# compressed gcode support, only when the libraries are installed
+if pkg-config --exists zlib; then
+	CFLAGS="${CFLAGS} -DCGINC_WITH_ZLIB"
+	LDFLAGS="${LDFLAGS} $(pkg-config --libs zlib)"
+fi
+if pkg-config --exists libzstd; then
+	CFLAGS="${CFLAGS} -DCGINC_WITH_ZSTD"
+	LDFLAGS="${LDFLAGS} $(pkg-config --libs libzstd)"
+fi
+
 mkdir -p build &&
 cc main.c -g -std=c99 -c ${CFLAGS} -o build/main.o &&
-cc build/main.o -s -Wall -std=c99 ${CFLAGS} -L/usr/local/lib/ ${LDFLAGS} -lm -o build/cginc &&
+cc build/main.o -s -Wall -std=c99 ${CFLAGS} -L/usr/local/lib/ ${LDFLAGS} -lGL -lpthread -lm -o build/cginc &&
 ./build/cginc test.nc resources/test.stl
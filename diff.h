@@ -0,0 +1,399 @@
+//compares the moves of two parsed programs
+//moves are hashed and aligned patience diff style: moves that appear exactly once in both programs are used as anchors,
+//the longest increasing run of them is kept and the gaps between them are aligned the same way,
+//this stays linear in memory so it works on programs with millions of moves
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "gcode.h"
+#include "line_index.h"
+
+#define DIFF_QUANTUM 1e-4f	//coordinates closer than this (in drawing units) count as the same
+#define DIFF_DP_LIMIT (1 << 22)	//gaps without anchors smaller than this (old*new moves) get an exact alignment
+
+enum{
+	DIFF_SAME = 0,
+	DIFF_REMOVED,	//only in the old program
+	DIFF_ADDED,	//only in the new program
+	DIFF_CHANGED,	//lines up with a different move in the other program
+};
+
+typedef struct DiffSide{
+	int *moves;	//segment index of every move
+	uint64_t *hashes;
+	uint8_t *status;	//per move
+	int count;
+}DiffSide;
+
+typedef struct Diff{
+	DiffSide a;	//old
+	DiffSide b;	//new
+	int same, removed, added, changed;
+}Diff;
+
+static uint64_t diff_mix(uint64_t h, uint64_t v){
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return h ^ (h >> 29);
+}
+
+static uint64_t diff_mix_float(uint64_t h, float v){
+	return diff_mix(h, (uint64_t)llroundf(v / DIFF_QUANTUM));
+}
+
+//the segment after an arc only marks where the arc ended, it is not a move of its own
+static bool diff_is_move(Segment *path, int i){
+	return !path[i-1].arc;
+}
+
+//a move is identified by where it starts, where it goes and how it gets there
+static uint64_t diff_hash_move(Segment *path, int i){
+	Segment *s = &path[i];
+	Vector3 from = path[i-1].point;
+
+	uint64_t h = 0;
+	h = diff_mix_float(h, from.x);
+	h = diff_mix_float(h, from.y);
+	h = diff_mix_float(h, from.z);
+	h = diff_mix_float(h, s->point.x);
+	h = diff_mix_float(h, s->point.y);
+	h = diff_mix_float(h, s->point.z);
+	h = diff_mix(h, (uint64_t)s->color.r << 16 | s->color.g << 8 | s->color.b);
+	if(s->arc){
+		h = diff_mix_float(h, s->center.x);
+		h = diff_mix_float(h, s->center.y);
+		h = diff_mix_float(h, s->angle);
+		h = diff_mix_float(h, s->k);
+	}
+	return h;
+}
+
+static void diff_side_init(DiffSide *d, Segment *path, int len){
+	d->moves = (int *)malloc(sizeof(int)*len);
+	d->hashes = (uint64_t *)malloc(sizeof(uint64_t)*len);
+	d->status = (uint8_t *)malloc(len);
+	d->count = 0;
+	if(d->moves == NULL || d->hashes == NULL || d->status == NULL){
+		perror("Could not allocate space for the diff!");
+		exit(-1);
+	}
+
+	for(int i=1; i<len; i++){
+		if(!diff_is_move(path, i)) continue;
+		d->moves[d->count] = i;
+		d->hashes[d->count] = diff_hash_move(path, i);
+		d->count++;
+	}
+}
+
+typedef struct DiffRegion{
+	int a0, a1, b0, b1;	//half open ranges of moves still to align
+}DiffRegion;
+
+typedef struct DiffSlot{
+	uint64_t hash;
+	int a_count, b_count;
+	int a_pos, b_pos;
+}DiffSlot;
+
+typedef struct DiffWork{
+	DiffRegion *stack;
+	int stack_len, stack_cap;
+	DiffSlot *table;	//hash table reused by every region
+	int table_cap;
+	int *anchors;	//a positions in b order
+	int *anchors_b;
+	int *tails;	//patience piles
+	int *prev;
+}DiffWork;
+
+static void diff_push(DiffWork *w, int a0, int a1, int b0, int b1){
+	if(a0 == a1 && b0 == b1) return;
+	if(w->stack_len == w->stack_cap){
+		w->stack_cap = w->stack_cap ? w->stack_cap*2 : 1024;
+		w->stack = (DiffRegion *)realloc(w->stack, sizeof(DiffRegion)*w->stack_cap);
+		if(w->stack == NULL){
+			perror("Could not allocate space for the diff!");
+			exit(-1);
+		}
+	}
+	w->stack[w->stack_len++] = (DiffRegion){a0, a1, b0, b1};
+}
+
+//what is left once nothing lines up any more: pair moves up in order, extra moves were added or removed
+static void diff_fill(Diff *d, int a0, int a1, int b0, int b1){
+	while(a0 < a1 && b0 < b1){
+		d->a.status[a0++] = DIFF_CHANGED;
+		d->b.status[b0++] = DIFF_CHANGED;
+	}
+	while(a0 < a1) d->a.status[a0++] = DIFF_REMOVED;
+	while(b0 < b1) d->b.status[b0++] = DIFF_ADDED;
+}
+
+//exact longest common subsequence for small gaps that have no unique moves to anchor on
+static void diff_align_small(Diff *d, int a0, int a1, int b0, int b1){
+	int n = a1 - a0, m = b1 - b0;
+	uint16_t *lcs = (uint16_t *)calloc((size_t)(n + 1)*(m + 1), sizeof(uint16_t));
+	if(lcs == NULL){
+		diff_fill(d, a0, a1, b0, b1);
+		return;
+	}
+	#define LCS(i, j) lcs[(size_t)(i)*(m + 1) + (j)]
+	for(int i=n-1; i>=0; i--){
+		for(int j=m-1; j>=0; j--){
+			if(d->a.hashes[a0 + i] == d->b.hashes[b0 + j]) LCS(i, j) = LCS(i + 1, j + 1) + 1;
+			else LCS(i, j) = LCS(i + 1, j) > LCS(i, j + 1) ? LCS(i + 1, j) : LCS(i, j + 1);
+		}
+	}
+
+	int i = 0, j = 0, gap_a = 0, gap_b = 0;
+	while(i < n && j < m){
+		if(d->a.hashes[a0 + i] == d->b.hashes[b0 + j]){
+			diff_fill(d, a0 + gap_a, a0 + i, b0 + gap_b, b0 + j);
+			d->a.status[a0 + i++] = DIFF_SAME;
+			d->b.status[b0 + j++] = DIFF_SAME;
+			gap_a = i;
+			gap_b = j;
+		}
+		else if(LCS(i + 1, j) >= LCS(i, j + 1)) i++;
+		else j++;
+	}
+	#undef LCS
+	diff_fill(d, a0 + gap_a, a1, b0 + gap_b, b1);
+	free(lcs);
+}
+
+static DiffSlot *diff_slot(DiffWork *w, int mask, uint64_t hash){
+	int i = (int)(hash & mask);
+	while(w->table[i].a_count + w->table[i].b_count > 0 && w->table[i].hash != hash) i = (i + 1) & mask;
+	w->table[i].hash = hash;
+	return &w->table[i];
+}
+
+static void diff_align_region(Diff *d, DiffWork *w, DiffRegion r){
+	uint64_t *ha = d->a.hashes, *hb = d->b.hashes;
+
+	//common start and end
+	while(r.a0 < r.a1 && r.b0 < r.b1 && ha[r.a0] == hb[r.b0]){
+		d->a.status[r.a0++] = DIFF_SAME;
+		d->b.status[r.b0++] = DIFF_SAME;
+	}
+	while(r.a0 < r.a1 && r.b0 < r.b1 && ha[r.a1 - 1] == hb[r.b1 - 1]){
+		d->a.status[--r.a1] = DIFF_SAME;
+		d->b.status[--r.b1] = DIFF_SAME;
+	}
+	if(r.a0 == r.a1 || r.b0 == r.b1){
+		diff_fill(d, r.a0, r.a1, r.b0, r.b1);
+		return;
+	}
+
+	//count every hash on both sides
+	int size = 1;
+	while(size < 2*(r.a1 - r.a0 + r.b1 - r.b0)) size <<= 1;
+	if(size > w->table_cap){
+		free(w->table);
+		w->table_cap = size;
+		w->table = (DiffSlot *)malloc(sizeof(DiffSlot)*size);
+		if(w->table == NULL){
+			perror("Could not allocate space for the diff!");
+			exit(-1);
+		}
+	}
+	memset(w->table, 0, sizeof(DiffSlot)*size);
+
+	for(int i=r.a0; i<r.a1; i++){
+		DiffSlot *slot = diff_slot(w, size - 1, ha[i]);
+		slot->a_count++;
+		slot->a_pos = i;
+	}
+	for(int i=r.b0; i<r.b1; i++){
+		DiffSlot *slot = diff_slot(w, size - 1, hb[i]);
+		slot->b_count++;
+		slot->b_pos = i;
+	}
+
+	//moves unique on both sides, in new program order
+	int n = 0;
+	for(int i=r.b0; i<r.b1; i++){
+		DiffSlot *slot = diff_slot(w, size - 1, hb[i]);
+		if(slot->a_count == 1 && slot->b_count == 1){
+			w->anchors[n] = slot->a_pos;
+			w->anchors_b[n] = i;
+			n++;
+		}
+	}
+
+	if(n == 0){
+		if((int64_t)(r.a1 - r.a0)*(r.b1 - r.b0) <= DIFF_DP_LIMIT) diff_align_small(d, r.a0, r.a1, r.b0, r.b1);
+		else diff_fill(d, r.a0, r.a1, r.b0, r.b1);
+		return;
+	}
+
+	//longest run of anchors that is increasing in the old program too, patience sorting
+	int piles = 0;
+	for(int i=0; i<n; i++){
+		int lo = 0, hi = piles;
+		while(lo < hi){
+			int mid = (lo + hi) / 2;
+			if(w->anchors[w->tails[mid]] < w->anchors[i]) lo = mid + 1;
+			else hi = mid;
+		}
+		w->prev[i] = lo > 0 ? w->tails[lo - 1] : -1;
+		w->tails[lo] = i;
+		if(lo == piles) piles++;
+	}
+
+	//walk the run backwards, everything between two anchors is a new region
+	int a_end = r.a1, b_end = r.b1;
+	for(int i = w->tails[piles - 1]; i >= 0; i = w->prev[i]){
+		int a = w->anchors[i], b = w->anchors_b[i];
+		d->a.status[a] = DIFF_SAME;
+		d->b.status[b] = DIFF_SAME;
+		diff_push(w, a + 1, a_end, b + 1, b_end);
+		a_end = a;
+		b_end = b;
+	}
+	diff_push(w, r.a0, a_end, r.b0, b_end);
+}
+
+//align the moves of old against new, the result has a status for every move of both
+Diff diff_paths(Segment *old_path, int old_len, Segment *new_path, int new_len){
+	Diff d = {0};
+	diff_side_init(&d.a, old_path, old_len);
+	diff_side_init(&d.b, new_path, new_len);
+
+	DiffWork w = {0};
+	int n = d.a.count > d.b.count ? d.a.count : d.b.count;
+	w.anchors = (int *)malloc(sizeof(int)*(n + 1));
+	w.anchors_b = (int *)malloc(sizeof(int)*(n + 1));
+	w.tails = (int *)malloc(sizeof(int)*(n + 1));
+	w.prev = (int *)malloc(sizeof(int)*(n + 1));
+	if(w.anchors == NULL || w.anchors_b == NULL || w.tails == NULL || w.prev == NULL){
+		perror("Could not allocate space for the diff!");
+		exit(-1);
+	}
+
+	diff_push(&w, 0, d.a.count, 0, d.b.count);
+	while(w.stack_len > 0){
+		DiffRegion r = w.stack[--w.stack_len];
+		diff_align_region(&d, &w, r);
+	}
+
+	free(w.stack);
+	free(w.table);
+	free(w.anchors);
+	free(w.anchors_b);
+	free(w.tails);
+	free(w.prev);
+
+	for(int i=0; i<d.a.count; i++){
+		if(d.a.status[i] == DIFF_SAME) d.same++;
+		else if(d.a.status[i] == DIFF_REMOVED) d.removed++;
+		else d.changed++;
+	}
+	for(int i=0; i<d.b.count; i++) if(d.b.status[i] == DIFF_ADDED) d.added++;
+
+	return d;
+}
+
+//colors for the viewer, the unchanged part of the old program is hidden under the new one
+static const Color diff_colors_old[] = {
+	[DIFF_SAME] = {0, 0, 0, 0},
+	[DIFF_REMOVED] = {255, 40, 40, 220},
+	[DIFF_CHANGED] = {255, 120, 0, 160},
+};
+static const Color diff_colors_new[] = {
+	[DIFF_SAME] = {128, 128, 128, 90},
+	[DIFF_ADDED] = {40, 255, 40, 220},
+	[DIFF_CHANGED] = {255, 230, 0, 220},
+};
+
+static void diff_color_side(DiffSide *d, Segment *path, int len, const Color *colors){
+	for(int i=0; i<d->count; i++){
+		int seg = d->moves[i];
+		path[seg].color = colors[d->status[i]];
+		if(path[seg].arc && seg + 1 < len) path[seg + 1].color = colors[d->status[i]];
+	}
+}
+
+//recolor both paths by diff status, has to happen before they are tessellated
+void diff_color_paths(Diff *d, Segment *old_path, int old_len, Segment *new_path, int new_len){
+	diff_color_side(&d->a, old_path, old_len, diff_colors_old);
+	diff_color_side(&d->b, new_path, new_len, diff_colors_new);
+}
+
+//segment of the next move after the given one that is not the same in both programs, -1 if there is none
+int diff_next_change(DiffSide *side, int segment){
+	//moves are stored in segment order, so find the first one past the segment
+	int lo = 0, hi = side->count;
+	while(lo < hi){
+		int mid = (lo + hi) / 2;
+		if(side->moves[mid] <= segment) lo = mid + 1;
+		else hi = mid;
+	}
+	for(int i=lo; i<side->count; i++){
+		if(side->status[i] != DIFF_SAME) return side->moves[i];
+	}
+	return -1;
+}
+
+//print the differences as hunks of source lines
+void diff_print_summary(Diff *d, char *old_file, LineIndex *old_lines, char *new_file, LineIndex *new_lines, int max_hunks){
+	printf("--- %s (%d moves)\n+++ %s (%d moves)\n", old_file, d->a.count, new_file, d->b.count);
+
+	int i = 0, j = 0, hunks = 0;
+	while(i < d->a.count || j < d->b.count){
+		if(i < d->a.count && j < d->b.count && d->a.status[i] == DIFF_SAME && d->b.status[j] == DIFF_SAME){
+			i++;
+			j++;
+			continue;
+		}
+
+		//a hunk runs until both sides line up again
+		int i0 = i, j0 = j, removed = 0, added = 0, changed = 0;
+		while(i < d->a.count && d->a.status[i] != DIFF_SAME){
+			if(d->a.status[i] == DIFF_REMOVED) removed++;
+			else changed++;
+			i++;
+		}
+		while(j < d->b.count && d->b.status[j] != DIFF_SAME){
+			if(d->b.status[j] == DIFF_ADDED) added++;
+			j++;
+		}
+
+		if(hunks++ < max_hunks){
+			uint32_t a_first = 0, a_last = 0, b_first = 0, b_last = 0;
+			if(i > i0){
+				line_index_get(old_lines, d->a.moves[i0], &a_first, NULL);
+				line_index_get(old_lines, d->a.moves[i - 1], &a_last, NULL);
+			}
+			if(j > j0){
+				line_index_get(new_lines, d->b.moves[j0], &b_first, NULL);
+				line_index_get(new_lines, d->b.moves[j - 1], &b_last, NULL);
+			}
+			printf("@@ -%u,%u +%u,%u @@ %d removed, %d added, %d changed\n",
+					a_first, i > i0 ? a_last - a_first + 1 : 0, b_first, j > j0 ? b_last - b_first + 1 : 0, removed, added, changed);
+		}
+	}
+
+	if(hunks > max_hunks) printf("... %d more hunks\n", hunks - max_hunks);
+	printf("%d hunks: %d moves the same, %d removed, %d added, %d changed\n", hunks, d->same, d->removed, d->added, d->changed);
+}
+
+void diff_free(Diff *d){
+	free(d->a.moves);
+	free(d->a.hashes);
+	free(d->a.status);
+	free(d->b.moves);
+	free(d->b.hashes);
+	free(d->b.status);
+	*d = (Diff){0};
+}
+
+#endif //DIFF_H
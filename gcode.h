@@ -0,0 +1,576 @@
+//gcode parsing into path segments
+#ifndef GCODE_H
+#define GCODE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "line_index.h"
+#include "gcode_stream.h"
+#include "profiler.h"
+#include "kinematics.h"
+#include "arcs.h"
+
+//macros
+#define BLEND_FACTOR   150	//0-255 where 255 is no blending and 0 is no color
+#define TRAVEL_COLOR   (Color){255, 0, 0, BLEND_FACTOR} // Red
+#define MOVE_COLOR     (Color){0, 255, 0, BLEND_FACTOR} // Green
+#define ARC_COLOR      (Color){0, 0, 255, BLEND_FACTOR} // Blue
+#define ARC_STEP 5	//degrees per line when drawing arcs
+
+//structures
+typedef struct Segment{
+	Vector3 point;	//end point for line or center for circle
+	Vector3 center;	//end point for line or center for circle
+	Color color;
+	float radius;	//arc radius
+	float angle;	//arc angle
+	float offset;	//arc quadrant offset
+	float k;	//z step
+	float feed;	//F and S in effect for the move, in program units
+	float spindle;
+	unsigned char type;	//motion command that made it, G0-G3
+	bool arc;
+}Segment;
+
+#define RAPID_RATE 5000.0f	//program units per minute when none is given, a small mill in mm
+
+extern float scale;	//drawing units per gcode unit, defined in main.c
+extern float rapid_rate;	//program units per minute rapids are timed at, defined in main.c
+
+
+//angle arc_point starts an arc segment at, it then goes on for s->angle degrees
+static float arc_start(Segment *s){
+	return s->angle >= 0 ? -s->offset : s->offset;
+}
+
+//point on an arc segment, what the path and the selection are drawn through,
+//the z rises evenly from center.z at the start by k over the whole sweep
+static Vector3 arc_point(Segment *s, float angle){
+	return (Vector3){
+		s->center.x + sinf(DEG2RAD*angle)*s->radius,
+		s->center.y - cosf(DEG2RAD*angle)*s->radius,
+		s->center.z + (s->angle != 0 ? (angle - arc_start(s))/s->angle*s->k : 0)
+	};
+}
+
+//length of the move ending at segment i in drawing units, arcs along the helix
+static float move_length(Segment *path, int i){
+	Segment *s = &path[i];
+	if(s->arc){
+		float sweep = fabsf(s->angle)*DEG2RAD*s->radius;
+		return sqrtf(sweep*sweep + s->k*s->k);
+	}
+	return Vector3Distance(path[i-1].point, s->point);
+}
+
+//seconds the move ending at segment i takes, rapids at rapid_rate, feed moves without a feed rate take none
+static float move_seconds(Segment *path, int i){
+	float rate = path[i].type == 0 ? rapid_rate : path[i].feed;
+	return rate > 0 ? move_length(path, i)/scale/rate*60 : 0;
+}
+
+//everything the parser carries from one line to the next, so the text can be fed in pieces split anywhere
+typedef struct GcodeParser{
+	Segment *segments;
+	int count;	//segments parsed so far, the first one is the origin
+	int capacity;
+	LineIndex *lines;
+
+	Vector3 last_position;
+	Vector3 l_end;
+	Color l_color;
+	unsigned char l_type;
+	bool absolute;
+	Vector3 l_rotary;	//A B C in degrees
+	float l_feed;
+	float l_spindle;
+
+	Vector3 *rotary;	//A B C at the end of every segment, only once the program turned a rotary axis
+	int rotary_cap;
+	bool kinematic;	//the segments went through the kinematics and were renumbered
+
+	ArcBatch arcs;	//scratch space for gcode_resolve_arcs
+	int resolved;	//segments before this one have their arc geometry
+
+	char line[1024];	//text of the line being put together
+	int line_len;
+	uint64_t offset;	//bytes fed so far
+	uint32_t line_number;
+	uint64_t line_offset;
+	bool line_complete;	//false while a long line is still being handed over in pieces
+}GcodeParser;
+
+void gcode_parser_init(GcodeParser *p, LineIndex *lines){
+	*p = (GcodeParser){ .lines = lines, .absolute = true, .line_complete = true };
+
+	p->capacity = 1024;
+	p->segments = (Segment *)malloc(sizeof(Segment)*p->capacity);
+	if(p->segments == NULL){
+		perror("Could not allocate space for segments!");
+		exit(-1);
+	}
+
+	p->segments[0].point.x = 0;
+	p->segments[0].point.y = 0;
+	p->segments[0].point.z = 0;
+	p->segments[0].color = BLACK;
+	p->segments[0].type = 0;
+	p->segments[0].feed = 0;
+	p->segments[0].spindle = 0;
+	p->segments[0].arc = false;
+	p->count = 1;
+	line_index_push(lines, 0, 0);	//the origin does not come from any line
+}
+
+//a word with a number after it, so the letters of comments and names are not taken for axes
+static char *gcode_word(char *line, char letter){
+	for(char *w = strchr(line, letter); w != NULL; w = strchr(w + 1, letter)){
+		char n = w[1];
+		if((n >= '0' && n <= '9') || n == '-' || n == '+' || n == '.') return w;
+	}
+	return NULL;
+}
+
+//keep the rotary position of every segment once the program has used a rotary axis
+static void gcode_record_rotary(GcodeParser *p, int first, bool rotary_word){
+	if(p->rotary == NULL && !rotary_word) return;
+	if(p->rotary_cap < p->capacity){
+		p->rotary = (Vector3 *)realloc(p->rotary, sizeof(Vector3)*p->capacity);
+		if(p->rotary == NULL){
+			perror("Could not allocate space for the rotary axes!");
+			exit(-1);
+		}
+		//everything before the first rotary word ran at zero
+		if(p->rotary_cap == 0) memset(p->rotary, 0, sizeof(Vector3)*first);
+		p->rotary_cap = p->capacity;
+	}
+	for(int n=first; n<p->count; n++) p->rotary[n] = p->l_rotary;
+}
+
+//interpret one line, or one piece of a line longer than the buffer, that starts at read_offset
+static void gcode_parse_line(GcodeParser *p, uint64_t read_offset){
+	char *line = p->line;
+	LineIndex *lines = p->lines;
+
+	if(p->line_complete){
+		p->line_number++;
+		p->line_offset = read_offset;
+	}
+	p->line_complete = strchr(line, '\n') != NULL;
+	uint32_t line_number = p->line_number;
+	uint64_t line_offset = p->line_offset;
+
+	char *end = NULL;
+	end = strchr(line, ';');	//find end of gcode command
+	if(end != NULL) *end = '\0';	//terminate string there
+
+	//feed and spindle speed are modal and often set on lines without a move
+	char *f_pos = gcode_word(line, 'F');
+	char *s_pos = gcode_word(line, 'S');
+	if(f_pos != NULL) p->l_feed = strtof(f_pos+1, NULL);
+	if(s_pos != NULL) p->l_spindle = strtof(s_pos+1, NULL);
+
+	char* c = strchr(line, 'G');	//look for g command in line
+	if(c != NULL) line = c;	//start intepreting from there
+	else return;	//or abort/ nothing for us to draw
+
+	//work on copies of the modal state and put them back at the end
+	Segment *segments = p->segments;
+	int seg_block = p->capacity;
+	int seg_index = p->count - 1;
+	Vector3 last_position = p->last_position;
+	Vector3 l_end = p->l_end;
+	Color l_color = p->l_color;
+	unsigned char l_type = p->l_type;
+	bool absolute = p->absolute;
+	Vector3 l_rotary = p->l_rotary;
+	bool rotary_word = false;
+
+	while(line != NULL){		//interpret all gcode command in line
+		int cmd = strtol(line+1, &line, 10);
+	
+		switch(cmd){
+		case 90:	//absolute mode
+			absolute = true;
+			break;
+		case 91:	//incremental mode
+			absolute = false;
+			break;
+		case 0:		//rapid
+			l_color = TRAVEL_COLOR;
+			l_type = cmd;
+			break;
+		case 1:		//feed
+			l_color = MOVE_COLOR;
+			l_type = cmd;
+			break;
+		case 2:	//clockwise arc
+		case 3:	//counterclockwise arc
+			l_color = ARC_COLOR;
+			l_type = cmd;
+			break;
+		default:
+			break;
+		}
+
+		if(cmd == 91 || cmd == 90) {	//these just change the coordinate system
+			char *tmp = strchr(line, 'G');
+			if(tmp != NULL) line = tmp;
+			continue;	//go to top of loop
+		}
+
+		float x,y,z;	//get coordinates
+		char *x_pos = strchr(line, 'X');
+		char *y_pos = strchr(line, 'Y');
+		char *z_pos = strchr(line, 'Z');
+		char *i_pos = strchr(line, 'I');
+		char *j_pos = strchr(line, 'J');
+		char *r_pos = strchr(line, 'R');
+
+		//check if axis gets moved
+		if(x_pos != NULL) x = strtof(x_pos+1, NULL)*scale;	//check if value present and get it
+		else if(cmd != 2 && cmd != 3) x = last_position.x;	//if its not and we are not in arc
+		else x = 0;	//if its not and we are in arc
+
+		if(y_pos != NULL) y = strtof(y_pos+1, NULL)*scale;
+		else if(cmd != 2 && cmd != 3) y = last_position.y;
+		else y = 0;
+
+		if(z_pos != NULL) z = strtof(z_pos+1, NULL)*scale;
+		else if(cmd != 2 && cmd != 3) z = last_position.z;
+		else z = 0;
+
+		if(absolute){	//this means we go to x
+			l_end.x = x;
+			l_end.y = y;
+			l_end.z = z;
+		}
+		else{		//this means we go x amount from where we are
+			l_end.x += x;
+			l_end.y += y;
+			l_end.z += z;
+		}
+
+		//rotary axes are in degrees, so they are never scaled
+		char *a_pos = gcode_word(line, 'A');
+		char *b_pos = gcode_word(line, 'B');
+		char *c_pos = gcode_word(line, 'C');
+		if(a_pos != NULL) l_rotary.x = strtof(a_pos+1, NULL) + (absolute ? 0 : l_rotary.x);
+		if(b_pos != NULL) l_rotary.y = strtof(b_pos+1, NULL) + (absolute ? 0 : l_rotary.y);
+		if(c_pos != NULL) l_rotary.z = strtof(c_pos+1, NULL) + (absolute ? 0 : l_rotary.z);
+		rotary_word = a_pos != NULL || b_pos != NULL || c_pos != NULL;
+
+		//allocate more segments if needed
+		if(seg_index >= seg_block-3){	//an arc adds two segments
+			seg_block += 1024;
+			PROFILE("grow") segments = (Segment *)realloc(segments, sizeof(Segment)*seg_block);
+			if(segments == NULL){
+				perror("Could not allocate more space for segments!");
+				exit(-1);
+			}
+		}
+
+		if(cmd == 2 || cmd == 3){	//arc
+
+			Vector3 center;
+
+			float i,j;
+
+			if(i_pos != NULL) i = strtof(i_pos+1, NULL)*scale;
+			else i = 0;
+			if(j_pos != NULL) j = strtof(j_pos+1, NULL)*scale;
+			else j = 0;
+
+
+			if(r_pos != NULL){
+				float radius = strtof(r_pos+1, NULL)*scale;
+				//trying to implement radius mode
+				//for any angle between the start of the arc and the end of it
+				//the center will lie on the tangent
+				float q = sqrt((l_end.x-last_position.x)*(l_end.x-last_position.x) + (l_end.y-last_position.y)*(l_end.y-last_position.y));
+
+				float y3 = (last_position.y+l_end.y)/2;
+				float x3 = (last_position.x+l_end.x)/2;
+
+				//a negative radius asks for the arc longer than half a circle, its center is on the other side,
+				//and an end just out of reach from rounding still gets the center half way
+				float h = radius*radius - q*q/4.0;
+				h = h > 0 && q > 0 ? sqrt(h)/q : 0;
+				if(radius < 0) h = -h;
+				float basex = h * (last_position.y-l_end.y); //calculate once
+				float basey = h * (l_end.x-last_position.x); //calculate once
+
+				if(cmd == 3){
+					center.x = x3 + basex; //center x of circle 1
+					center.y = y3 + basey; //center y of circle 1
+				}
+				else {
+					center.x = x3 - basex; //center x of circle 2
+					center.y = y3 - basey; //center y of circle 2
+				}
+			}
+			else{
+				if(absolute){
+					center.x = i;
+					center.y = j;
+				}
+				else{
+					center.x = last_position.x + i;
+					center.y = last_position.y + j;
+				}
+			}
+			if(z_pos == NULL) l_end.z = last_position.z;
+			center.z = last_position.z;	//arcs are in the xy plane, a helix climbs k from where it starts so K is not needed
+
+			seg_index++;
+			line_index_push(lines, line_number, line_offset);
+			segments[seg_index].point.x = l_end.x;
+			segments[seg_index].point.y = l_end.y;
+			segments[seg_index].point.z = l_end.z;
+			segments[seg_index].center.x = center.x;
+			segments[seg_index].center.y = center.y;
+			segments[seg_index].center.z = center.z;
+			segments[seg_index].color = l_color;
+			segments[seg_index].type = l_type;
+			segments[seg_index].radius = 0;	//radius, angle and offset come from gcode_resolve_arcs
+			segments[seg_index].angle = 0;
+			segments[seg_index].offset = 0;
+			segments[seg_index].k = l_end.z - last_position.z;
+			segments[seg_index].feed = p->l_feed;
+			segments[seg_index].spindle = p->l_spindle;
+			segments[seg_index].arc = true;
+		}
+		else {
+			//DrawLine3D(last_position, l_end, l_color);
+		}
+		//this is added for the next line too use as start
+		seg_index++;
+		line_index_push(lines, line_number, line_offset);
+		segments[seg_index].point.x = l_end.x;
+		segments[seg_index].point.y = l_end.y;
+		segments[seg_index].point.z = l_end.z;
+		segments[seg_index].color = l_color;
+		segments[seg_index].type = l_type;
+		segments[seg_index].feed = p->l_feed;
+		segments[seg_index].spindle = p->l_spindle;
+		segments[seg_index].arc = false;
+
+
+		last_position.x = l_end.x;
+		last_position.y = l_end.y;
+		last_position.z = l_end.z;
+
+		break;	//out of loop
+	}
+
+	int first = p->count;
+	p->segments = segments;
+	p->capacity = seg_block;
+	p->count = seg_index + 1;
+	p->last_position = last_position;
+	p->l_end = l_end;
+	p->l_color = l_color;
+	p->l_type = l_type;
+	p->absolute = absolute;
+	p->l_rotary = l_rotary;
+	gcode_record_rotary(p, first, rotary_word);
+}
+
+//copy start, end, center and direction of the arcs among segments [from, to) into the batch after its first count arcs
+int gcode_gather_arcs(Segment *seg, int from, int to, ArcBatch *b, int count){
+	int added = 0;
+	for(int n=from; n<to; n++) if(seg[n].arc) added++;
+	arc_batch_reserve(b, count + added);
+
+	for(int n=from; n<to; n++){
+		if(!seg[n].arc) continue;
+		b->sx[count] = seg[n-1].point.x;
+		b->sy[count] = seg[n-1].point.y;
+		b->ex[count] = seg[n].point.x;
+		b->ey[count] = seg[n].point.y;
+		b->cx[count] = seg[n].center.x;
+		b->cy[count] = seg[n].center.y;
+		b->dir[count] = seg[n].type == 3 ? 1 : -1;
+		count++;
+	}
+	return count;
+}
+
+//work out radius, sweep and start angle of the arcs parsed since the last call, all in one batch
+static void gcode_resolve_arcs(GcodeParser *p){
+	Segment *seg = p->segments;
+	ArcBatch *b = &p->arcs;
+	int count = gcode_gather_arcs(seg, p->resolved, p->count, b, 0);
+	if(count == 0){
+		p->resolved = p->count;
+		return;
+	}
+
+	arc_resolve(b, count);
+
+	int fishy = 0, first_fishy = 0;
+	count = 0;
+	for(int n=p->resolved; n<p->count; n++){
+		if(!seg[n].arc) continue;
+		seg[n].radius = b->radius[count];
+		seg[n].angle = b->angle[count];
+		seg[n].offset = b->offset[count];
+		//For the gcode to be valid, the start and end radius should be equal, or close enough
+		if(b->mismatch[count] > ARC_RADIUS_TOLERANCE && fishy++ == 0) first_fishy = n;
+		count++;
+	}
+	if(fishy){
+		uint32_t line = 0;
+		line_index_get(p->lines, first_fishy, &line, NULL);
+		printf("Something's fishy about %d arc%s, the first is on line %u, check it again\n", fishy, fishy > 1 ? "s" : "", line);
+	}
+	p->resolved = p->count;
+}
+
+//parse as much of buf as makes up whole lines, the rest is kept for the next call
+void gcode_parser_feed(GcodeParser *p, const char *buf, size_t len){
+	while(len > 0){
+		//lines are cut into pieces of at most 1022 characters, like fgets(line, 1023) did
+		size_t room = 1022 - p->line_len;
+		size_t take = len < room ? len : room;
+		const char *nl = (const char *)memchr(buf, '\n', take);
+		if(nl) take = nl - buf + 1;
+
+		memcpy(p->line + p->line_len, buf, take);
+		p->line_len += take;
+		p->offset += take;
+		buf += take;
+		len -= take;
+
+		if(nl || p->line_len == 1022){
+			p->line[p->line_len] = '\0';
+			gcode_parse_line(p, p->offset - p->line_len);
+			p->line_len = 0;
+		}
+	}
+	gcode_resolve_arcs(p);
+}
+
+//parse a last line that did not end in a newline, the segments stay with the parser
+void gcode_parser_finish(GcodeParser *p){
+	if(p->line_len > 0){
+		p->line[p->line_len] = '\0';
+		gcode_parse_line(p, p->offset - p->line_len);
+		p->line_len = 0;
+	}
+	gcode_resolve_arcs(p);
+	arc_batch_free(&p->arcs);
+}
+
+//how many points the kinematics cut the move ending at segment n into, the marker after an arc has none
+static int gcode_kinematic_steps(GcodeParser *p, int n){
+	Segment *s = &p->segments[n];
+	if(p->segments[n-1].arc) return 0;
+
+	Vector3 d = Vector3Subtract(p->rotary[n], p->rotary[n-1]);
+	float turn = fmaxf(fabsf(d.x), fmaxf(fabsf(d.y), fabsf(d.z)));
+	int steps = (int)ceilf(turn/kinematics.max_step);
+	if(s->arc){
+		int arc_steps = (int)ceilf(fabsf(s->angle)/ARC_STEP);
+		if(arc_steps > steps) steps = arc_steps;
+	}
+	return steps > 1 ? steps : 1;
+}
+
+//put the moves of a program that used rotary axes through the kinematics, so they end up where the tool touched the part:
+//moves that turn further than kinematics.max_step are cut into sub segments and arcs into lines,
+//since both stop being straight or round once the part turns, every piece keeps the line it came from
+void gcode_parser_apply_kinematics(GcodeParser *p){
+	if(p->rotary == NULL) return;
+	Segment *seg = p->segments;
+	Vector3 *rot = p->rotary;
+
+	//count first, so the batch is allocated once
+	int total = 1;
+	for(int n=1; n<p->count; n++) total += gcode_kinematic_steps(p, n);
+
+	float *x = (float *)malloc(sizeof(float)*6*total);
+	Segment *out = (Segment *)malloc(sizeof(Segment)*(total + 1));
+	if(x == NULL || out == NULL){
+		perror("Could not allocate space for the kinematics!");
+		exit(-1);
+	}
+	float *y = x + total, *z = y + total, *a = z + total, *b = a + total, *c = b + total;
+	LineIndex lines = {0};
+
+	//joint positions of every point as arrays, with the attributes of the move they belong to
+	int m = 0;
+	for(int n=0; n<p->count; n++){
+		int steps = n == 0 ? 1 : gcode_kinematic_steps(p, n);
+		Segment *s = &seg[n];
+		uint32_t line;
+		uint64_t offset;
+		line_index_get(p->lines, n, &line, &offset);
+
+		float start = arc_start(s);
+		for(int j=1; j<=steps; j++, m++){
+			float f = (float)j/steps;
+			Vector3 pos = s->point, r = rot[n];
+			if(j < steps){
+				pos = s->arc ? arc_point(s, start + f*s->angle) : Vector3Lerp(seg[n-1].point, s->point, f);
+				r = Vector3Lerp(rot[n-1], rot[n], f);
+			}
+			x[m] = pos.x; y[m] = pos.y; z[m] = pos.z;
+			a[m] = r.x; b[m] = r.y; c[m] = r.z;
+			out[m] = (Segment){ .color = s->color, .type = s->type, .feed = s->feed, .spindle = s->spindle };
+			line_index_push(&lines, line, offset);
+		}
+	}
+
+	PROFILE("kinematics") kinematics_transform(&kinematics, total, x, y, z, a, b, c);
+	for(int i=0; i<total; i++) out[i].point = (Vector3){x[i], y[i], z[i]};
+
+	free(x);
+	free(p->segments);
+	free(p->rotary);
+	line_index_free(p->lines);
+	*p->lines = lines;
+	p->segments = out;
+	p->count = total;
+	p->capacity = total + 1;
+	p->rotary = NULL;
+	p->rotary_cap = 0;
+	p->kinematic = true;
+}
+
+//the number of points, -1 if the file can not be read, the caller decides whether that ends the program
+int parse_gcode(char *gcode_file, Segment **output, LineIndex *lines){
+
+	printf("Parsing Gcode\n");
+
+	GcodeStream *g = gcode_stream_open(gcode_file);
+	if(g == NULL){
+		printf("Gcode file: \"%s\" can not be read!\n", gcode_file);
+		return -1;
+	}
+
+	GcodeParser parser;
+	gcode_parser_init(&parser, lines);
+
+	char *buf = (char *)malloc(STREAM_BUFFER_SIZE);
+	if(buf == NULL){
+		perror("Could not allocate space for reading!");
+		exit(-1);
+	}
+	size_t n;
+	while((n = gcode_stream_read(g, buf, STREAM_BUFFER_SIZE)) > 0) gcode_parser_feed(&parser, buf, n);
+	gcode_parser_finish(&parser);
+	printf("EOF Reached\n");
+	gcode_parser_apply_kinematics(&parser);
+
+	gcode_stream_close(g);
+	free(buf);
+
+	*output = parser.segments;
+	printf("Parsing Complete, %d points found!\n", parser.count);
+	return parser.count;
+}
+
+#endif //GCODE_H
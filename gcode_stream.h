@@ -0,0 +1,367 @@
+//reader for gcode files that may be gzip or zstd compressed, picked by the magic bytes and not the name
+//compressed files are inflated on their own thread into a ring of buffers, so parsing never waits on
+//decompression unless it is the slower of the two
+//"-" reads stdin, pipes work too, reads return whatever has arrived so far instead of waiting for a full buffer
+//build with CGINC_WITH_ZLIB and/or CGINC_WITH_ZSTD defined to enable the formats (compile.sh does it if it finds them)
+#ifndef GCODE_STREAM_H
+#define GCODE_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef CGINC_WITH_ZLIB
+	#include <zlib.h>
+#endif
+#ifdef CGINC_WITH_ZSTD
+	#include <zstd.h>
+#endif
+
+#define STREAM_BUFFERS 4	//decompressed buffers in flight between the two threads
+#define STREAM_BUFFER_SIZE (1 << 20)
+#define STREAM_INPUT_SIZE (256 << 10)	//compressed bytes read from the file at a time
+
+enum{
+	STREAM_PLAIN,
+	STREAM_GZIP,
+	STREAM_ZSTD,
+};
+
+typedef struct GcodeStream{
+	const char *name;
+	int fd;
+	int format;
+	unsigned char magic[4];	//bytes read to find the format that could not be seeked back over
+	int magic_len;
+	int magic_pos;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t emptied;
+	char *buffers[STREAM_BUFFERS];
+	size_t lengths[STREAM_BUFFERS];
+	uint64_t produced;	//buffers handed over so far, the ring slot is this modulo STREAM_BUFFERS
+	uint64_t consumed;
+	bool done;	//nothing more will be produced
+	bool stop;	//the reader closed the stream early
+
+	//decompression side
+	unsigned char *input;
+	bool input_done;
+#ifdef CGINC_WITH_ZLIB
+	z_stream zlib;
+#endif
+#ifdef CGINC_WITH_ZSTD
+	ZSTD_DStream *zstd;
+	ZSTD_inBuffer zstd_in;
+	size_t zstd_left;	//0 when the last frame was complete
+#endif
+
+	//reading side
+	char *plain;	//read straight into this when not compressed
+	char *data;	//buffer being read, still owned by the reader
+	size_t len;
+	size_t pos;
+	uint64_t offset;	//in decompressed bytes
+}GcodeStream;
+
+//raw bytes from the file, returns as soon as there are any, 0 at the end
+static size_t stream_read_raw(GcodeStream *s, void *buf, size_t cap){
+	if(s->magic_pos < s->magic_len){
+		size_t n = s->magic_len - s->magic_pos;
+		if(n > cap) n = cap;
+		memcpy(buf, s->magic + s->magic_pos, n);
+		s->magic_pos += n;
+		return n;
+	}
+	ssize_t n;
+	do n = read(s->fd, buf, cap); while(n < 0 && errno == EINTR);
+	if(n < 0) printf("Could not read \"%s\": %s\n", s->name, strerror(errno));
+	return n > 0 ? n : 0;
+}
+
+#ifdef CGINC_WITH_ZLIB
+static size_t stream_inflate(GcodeStream *s, char *out, size_t cap){
+	z_stream *z = &s->zlib;
+	z->next_out = (Bytef *)out;
+	z->avail_out = cap;
+	while(z->avail_out > 0){
+		if(z->avail_in == 0){
+			z->next_in = s->input;
+			z->avail_in = stream_read_raw(s, s->input, STREAM_INPUT_SIZE);
+			if(z->avail_in == 0){
+				if(z->total_in > 0) printf("Gcode file: \"%s\" is truncated, only the start of it was read\n", s->name);	//inside a member
+				s->input_done = true;
+				break;
+			}
+		}
+		int ret = inflate(z, Z_NO_FLUSH);
+		if(ret == Z_STREAM_END) inflateReset(z);	//gzip files can be several members one after the other
+		else if(ret != Z_OK && !(ret == Z_BUF_ERROR && z->avail_in == 0)){
+			printf("Gcode file: \"%s\" is corrupt (%s), only the start of it was read\n", s->name, z->msg ? z->msg : "inflate failed");
+			s->input_done = true;
+			break;
+		}
+	}
+	return cap - z->avail_out;
+}
+#endif
+
+#ifdef CGINC_WITH_ZSTD
+static size_t stream_unzstd(GcodeStream *s, char *out, size_t cap){
+	ZSTD_outBuffer o = {out, cap, 0};
+	while(o.pos < o.size){
+		if(s->zstd_in.pos == s->zstd_in.size){
+			s->zstd_in.src = s->input;
+			s->zstd_in.size = stream_read_raw(s, s->input, STREAM_INPUT_SIZE);
+			s->zstd_in.pos = 0;
+			if(s->zstd_in.size == 0){
+				if(s->zstd_left != 0) printf("Gcode file: \"%s\" is truncated, only the start of it was read\n", s->name);
+				s->input_done = true;
+				break;
+			}
+		}
+		size_t ret = s->zstd_left = ZSTD_decompressStream(s->zstd, &o, &s->zstd_in);
+		if(ZSTD_isError(ret)){
+			printf("Gcode file: \"%s\" is corrupt (%s), only the start of it was read\n", s->name, ZSTD_getErrorName(ret));
+			s->input_done = true;
+			break;
+		}
+	}
+	return o.pos;
+}
+#endif
+
+static void *stream_decompress_thread(void *arg){
+	GcodeStream *s = (GcodeStream *)arg;
+
+	while(!s->input_done){
+		pthread_mutex_lock(&s->lock);
+		while(s->produced - s->consumed == STREAM_BUFFERS && !s->stop) pthread_cond_wait(&s->emptied, &s->lock);
+		bool stop = s->stop;
+		pthread_mutex_unlock(&s->lock);
+		if(stop) break;
+
+		//the slot is free, the reader only touches slots that were produced
+		int slot = s->produced % STREAM_BUFFERS;
+		size_t len = 0;
+#ifdef CGINC_WITH_ZLIB
+		if(s->format == STREAM_GZIP) len = stream_inflate(s, s->buffers[slot], STREAM_BUFFER_SIZE);
+#endif
+#ifdef CGINC_WITH_ZSTD
+		if(s->format == STREAM_ZSTD) len = stream_unzstd(s, s->buffers[slot], STREAM_BUFFER_SIZE);
+#endif
+		if(len == 0) break;
+
+		pthread_mutex_lock(&s->lock);
+		s->lengths[slot] = len;
+		s->produced++;
+		pthread_cond_signal(&s->filled);
+		pthread_mutex_unlock(&s->lock);
+	}
+
+	pthread_mutex_lock(&s->lock);
+	s->done = true;
+	pthread_cond_signal(&s->filled);
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+//stdin and pipes can only be read once, and only as fast as whatever writes them
+bool gcode_stream_is_live(const char *file){
+	struct stat st;
+	return strcmp(file, "-") == 0 || (stat(file, &st) == 0 && S_ISFIFO(st.st_mode));
+}
+
+//NULL if the file can not be opened or is compressed in a format this build can not read
+GcodeStream *gcode_stream_open(const char *file){
+	int fd = strcmp(file, "-") == 0 ? STDIN_FILENO : open(file, O_RDONLY);
+	if(fd < 0) return NULL;
+
+	GcodeStream *s = (GcodeStream *)calloc(1, sizeof(GcodeStream));
+	if(s == NULL){
+		perror("Could not allocate the gcode reader!");
+		exit(-1);
+	}
+	s->name = file;
+	s->fd = fd;
+
+	//a pipe blocks here until the first bytes arrive, they are kept if there is no seeking back
+	int got = 0;
+	ssize_t n;
+	while(got < 4 && ((n = read(fd, s->magic + got, 4 - got)) > 0 || (n < 0 && errno == EINTR))) got += n > 0 ? n : 0;
+	if(lseek(fd, 0, SEEK_SET) != 0) s->magic_len = got;
+
+	unsigned char *magic = s->magic;
+	s->format = STREAM_PLAIN;
+	if(got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) s->format = STREAM_GZIP;
+	if(got >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) s->format = STREAM_ZSTD;
+	if(s->format == STREAM_PLAIN){
+		s->plain = (char *)malloc(STREAM_BUFFER_SIZE);
+		if(s->plain == NULL){
+			perror("Could not allocate space for reading!");
+			exit(-1);
+		}
+		return s;
+	}
+
+#ifdef CGINC_WITH_ZLIB
+	if(s->format == STREAM_GZIP && inflateInit2(&s->zlib, 15 + 16) != Z_OK){
+		printf("Could not start inflating \"%s\"\n", file);
+		exit(-1);
+	}
+#else
+	if(s->format == STREAM_GZIP){
+		printf("Gcode file: \"%s\" is gzip compressed, build with CGINC_WITH_ZLIB to read it\n", file);
+		if(fd != STDIN_FILENO) close(fd);
+		free(s);
+		return NULL;
+	}
+#endif
+#ifdef CGINC_WITH_ZSTD
+	if(s->format == STREAM_ZSTD){
+		s->zstd = ZSTD_createDStream();
+		if(s->zstd == NULL){
+			printf("Could not start decompressing \"%s\"\n", file);
+			exit(-1);
+		}
+		ZSTD_initDStream(s->zstd);
+	}
+#else
+	if(s->format == STREAM_ZSTD){
+		printf("Gcode file: \"%s\" is zstd compressed, build with CGINC_WITH_ZSTD to read it\n", file);
+		if(fd != STDIN_FILENO) close(fd);
+		free(s);
+		return NULL;
+	}
+#endif
+
+	s->input = (unsigned char *)malloc(STREAM_INPUT_SIZE);
+	for(int i=0; i<STREAM_BUFFERS; i++) s->buffers[i] = (char *)malloc(STREAM_BUFFER_SIZE);
+	for(int i=0; i<STREAM_BUFFERS; i++){
+		if(s->input == NULL || s->buffers[i] == NULL){
+			perror("Could not allocate space for decompressing!");
+			exit(-1);
+		}
+	}
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->filled, NULL);
+	pthread_cond_init(&s->emptied, NULL);
+	pthread_create(&s->thread, NULL, stream_decompress_thread, s);
+	return s;
+}
+
+//hand the buffer being read back to the decompression thread and wait for the next one
+static bool stream_next_buffer(GcodeStream *s){
+	if(s->format == STREAM_PLAIN){
+		s->data = s->plain;
+		s->len = stream_read_raw(s, s->plain, STREAM_BUFFER_SIZE);
+		s->pos = 0;
+		return s->len > 0;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	if(s->data != NULL){
+		s->consumed++;
+		pthread_cond_signal(&s->emptied);
+	}
+	while(s->produced == s->consumed && !s->done) pthread_cond_wait(&s->filled, &s->lock);
+
+	bool more = s->produced != s->consumed;
+	s->data = more ? s->buffers[s->consumed % STREAM_BUFFERS] : NULL;
+	s->len = more ? s->lengths[s->consumed % STREAM_BUFFERS] : 0;
+	s->pos = 0;
+	pthread_mutex_unlock(&s->lock);
+	return more;
+}
+
+//same contract as fgets
+char *gcode_stream_gets(GcodeStream *s, char *buf, int size){
+	int n = 0;
+	while(n < size - 1){
+		if(s->pos == s->len && !stream_next_buffer(s)) break;
+
+		size_t take = s->len - s->pos;
+		if(take > (size_t)(size - 1 - n)) take = size - 1 - n;
+		char *nl = (char *)memchr(s->data + s->pos, '\n', take);
+		if(nl) take = nl - (s->data + s->pos) + 1;
+
+		memcpy(buf + n, s->data + s->pos, take);
+		n += take;
+		s->pos += take;
+		s->offset += take;
+		if(nl) break;
+	}
+	if(n == 0) return NULL;
+	buf[n] = '\0';
+	return buf;
+}
+
+//whatever text is ready, up to size bytes, only waits when there is none, 0 at the end
+size_t gcode_stream_read(GcodeStream *s, char *buf, size_t size){
+	if(s->pos == s->len && !stream_next_buffer(s)) return 0;
+	size_t take = s->len - s->pos;
+	if(take > size) take = size;
+	memcpy(buf, s->data + s->pos, take);
+	s->pos += take;
+	s->offset += take;
+	return take;
+}
+
+//offset of the next byte gets will return, in the decompressed text
+uint64_t gcode_stream_tell(GcodeStream *s){
+	return s->offset;
+}
+
+//move forward to a decompressed offset, compressed files and pipes have to be read up to it
+bool gcode_stream_skip(GcodeStream *s, uint64_t offset){
+	if(s->format == STREAM_PLAIN && s->magic_len == 0 && lseek(s->fd, (off_t)offset, SEEK_SET) == (off_t)offset){
+		s->pos = s->len = 0;
+		s->offset = offset;
+		return true;
+	}
+
+	while(s->offset < offset){
+		if(s->pos == s->len && !stream_next_buffer(s)) return false;
+		size_t take = s->len - s->pos;
+		if(take > offset - s->offset) take = offset - s->offset;
+		s->pos += take;
+		s->offset += take;
+	}
+	return true;
+}
+
+void gcode_stream_close(GcodeStream *s){
+	if(s->format != STREAM_PLAIN){
+		pthread_mutex_lock(&s->lock);
+		s->stop = true;
+		pthread_cond_signal(&s->emptied);
+		pthread_mutex_unlock(&s->lock);
+		pthread_join(s->thread, NULL);
+
+#ifdef CGINC_WITH_ZLIB
+		if(s->format == STREAM_GZIP) inflateEnd(&s->zlib);
+#endif
+#ifdef CGINC_WITH_ZSTD
+		if(s->format == STREAM_ZSTD) ZSTD_freeDStream(s->zstd);
+#endif
+		for(int i=0; i<STREAM_BUFFERS; i++) free(s->buffers[i]);
+		free(s->input);
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->filled);
+		pthread_cond_destroy(&s->emptied);
+	}
+	free(s->plain);
+	if(s->fd != STDIN_FILENO) close(s->fd);
+	free(s);
+}
+
+#endif //GCODE_STREAM_H
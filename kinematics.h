@@ -0,0 +1,93 @@
+//machine kinematics for programs with rotary axes, turns joint positions (X Y Z plus A B C in degrees)
+//into tool tip positions on the part, A turns about X, B about Y and C about Z
+//the transform runs over plain float arrays a block at a time, with no branches or libm calls in the loops,
+//so the compiler can vectorize it and million move programs stay quick to load
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <stdbool.h>
+#include <string.h>
+
+#define KIN_BLOCK 1024	//points per batch, small enough for the sines to stay in cache
+
+enum{
+	KIN_TABLE_TABLE,	//trunnion, A/B tilts the table that C turns, the tool never tilts
+	KIN_HEAD_TABLE,		//A/B tilts the spindle head about its pivot, C turns the table
+};
+
+typedef struct Kinematics{
+	int model;
+	Vector3 pivot;	//point the table turns about, drawing units
+	float head_length;	//head-table only, from the head pivot to the tool tip, drawing units
+	float max_step;	//degrees a rotary move may turn before it gets cut into sub segments
+}Kinematics;
+
+extern Kinematics kinematics;	//defined in main.c
+
+//"table-table" or "head-table", false if the name is not known
+bool parse_kinematics_model(const char *name, Kinematics *k){
+	if(strcmp(name, "table-table") == 0) k->model = KIN_TABLE_TABLE;
+	else if(strcmp(name, "head-table") == 0) k->model = KIN_HEAD_TABLE;
+	else return false;
+	return true;
+}
+
+//sine of an angle in turns, good to a few millionths, which is plenty for drawing
+static inline float kin_sin_turns(float t){
+	t -= (float)(int)(t + (t >= 0 ? 0.5f : -0.5f));	//wrap to [-0.5, 0.5]
+	float x = t*2*PI;
+	x = x > PI/2 ? PI - x : (x < -PI/2 ? -PI - x : x);	//fold to [-pi/2, pi/2]
+	float x2 = x*x;
+	return x*(1 + x2*(-1/6.0f + x2*(1/120.0f + x2*(-1/5040.0f + x2*(1/362880.0f)))));
+}
+
+static void kin_sincos(int count, const float *deg, float *s, float *c){
+	for(int i=0; i<count; i++){
+		float t = deg[i]*(1/360.0f);
+		s[i] = kin_sin_turns(t);
+		c[i] = kin_sin_turns(t + 0.25f);
+	}
+}
+
+//the table turned the part by A, B then C about the pivot, turn the point back by the same to get it on the part
+static void kin_table_table(const Kinematics *k, int count, float *x, float *y, float *z,
+		const float *sa, const float *ca, const float *sb, const float *cb, const float *sc, const float *cc){
+	for(int i=0; i<count; i++){
+		float px = x[i] - k->pivot.x, py = y[i] - k->pivot.y, pz = z[i] - k->pivot.z;
+		float qy = ca[i]*py + sa[i]*pz, qz = ca[i]*pz - sa[i]*py;	//about x by -A
+		float qx = cb[i]*px - sb[i]*qz; pz = sb[i]*px + cb[i]*qz;	//about y by -B
+		x[i] = k->pivot.x + cc[i]*qx + sc[i]*qy;	//about z by -C
+		y[i] = k->pivot.y + cc[i]*qy - sc[i]*qx;
+		z[i] = k->pivot.z + pz;
+	}
+}
+
+//xyz is where the head pivot is, the tool hangs head_length below it tilted by A and B, then C turns the part
+static void kin_head_table(const Kinematics *k, int count, float *x, float *y, float *z,
+		const float *sa, const float *ca, const float *sb, const float *cb, const float *sc, const float *cc){
+	float l = k->head_length;
+	for(int i=0; i<count; i++){
+		float px = x[i] - l*sb[i] - k->pivot.x;
+		float py = y[i] + l*cb[i]*sa[i] - k->pivot.y;
+		float pz = z[i] - l*cb[i]*ca[i];
+		x[i] = k->pivot.x + cc[i]*px + sc[i]*py;
+		y[i] = k->pivot.y + cc[i]*py - sc[i]*px;
+		z[i] = pz;
+	}
+}
+
+//turn count joint positions into tool tip positions in place, the angles are in degrees
+void kinematics_transform(const Kinematics *k, int count, float *x, float *y, float *z, const float *a, const float *b, const float *c){
+	float sa[KIN_BLOCK], ca[KIN_BLOCK], sb[KIN_BLOCK], cb[KIN_BLOCK], sc[KIN_BLOCK], cc[KIN_BLOCK];
+
+	for(int first=0; first<count; first += KIN_BLOCK){
+		int n = count - first < KIN_BLOCK ? count - first : KIN_BLOCK;
+		kin_sincos(n, a + first, sa, ca);
+		kin_sincos(n, b + first, sb, cb);
+		kin_sincos(n, c + first, sc, cc);
+		if(k->model == KIN_HEAD_TABLE) kin_head_table(k, n, x + first, y + first, z + first, sa, ca, sb, cb, sc, cc);
+		else kin_table_table(k, n, x + first, y + first, z + first, sa, ca, sb, cb, sc, cc);
+	}
+}
+
+#endif //KINEMATICS_H
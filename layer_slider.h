@@ -0,0 +1,142 @@
+//on screen controls for the path filter: a z range slider with two handles and motion type toggles
+#ifndef LAYER_SLIDER_H
+#define LAYER_SLIDER_H
+
+#include <float.h>
+#include "toolpath.h"
+
+#define SLIDER_WIDTH 40
+#define SLIDER_MARGIN 10
+#define SLIDER_HANDLE 8
+
+typedef struct LayerSlider{
+	float lo, hi;	//z range of all the loaded paths
+	int dragging;	//0 nothing, 1 the bottom handle, 2 the top handle
+	bool captured;	//the mouse is busy with the controls, the camera should leave it alone
+}LayerSlider;
+
+static const char *type_names[] = {"G0", "G1", "G2", "G3"};
+
+//the slider covers every path that was loaded
+void InitLayerSlider(LayerSlider *ls, PathFilter *f, Toolpath *tps, int count){
+	ls->lo = FLT_MAX;
+	ls->hi = -FLT_MAX;
+	for(int i=0; i<count; i++){
+		if(tps[i].layer_count == 0) continue;
+		if(tps[i].layers[0] < ls->lo) ls->lo = tps[i].layers[0];
+		if(tps[i].layers[tps[i].layer_count-1] > ls->hi) ls->hi = tps[i].layers[tps[i].layer_count-1];
+	}
+	if(ls->lo > ls->hi) ls->lo = ls->hi = 0;
+
+	f->z_min = ls->lo;
+	f->z_max = ls->hi;
+	f->types = 0x0f;
+}
+
+static Rectangle slider_track(void){
+	return (Rectangle){GetScreenWidth() - SLIDER_WIDTH - SLIDER_MARGIN, 40, SLIDER_WIDTH, GetScreenHeight() - 40 - 4*24 - 3*SLIDER_MARGIN};
+}
+
+static Rectangle slider_type_box(int type){
+	Rectangle track = slider_track();
+	return (Rectangle){track.x, track.y + track.height + SLIDER_MARGIN + type*24, SLIDER_WIDTH, 20};
+}
+
+static float slider_y(LayerSlider *ls, float z){
+	Rectangle track = slider_track();
+	float t = ls->hi > ls->lo ? (z - ls->lo) / (ls->hi - ls->lo) : 0;
+	return track.y + track.height - t*track.height;
+}
+
+static float slider_z(LayerSlider *ls, float y){
+	Rectangle track = slider_track();
+	float t = (track.y + track.height - y) / track.height;
+	if(t < 0) t = 0;
+	if(t > 1) t = 1;
+	return ls->lo + t*(ls->hi - ls->lo);
+}
+
+//returns true when the filter changed and the paths need new draw ranges,
+//page up/down step the top handle through the layers of tp, with shift held the bottom one
+bool UpdateLayerSlider(LayerSlider *ls, PathFilter *f, Toolpath *tp){
+	bool changed = false;
+	Vector2 mouse = GetMousePosition();
+	Rectangle track = slider_track();
+	Rectangle grab = {track.x, track.y - SLIDER_HANDLE, track.width, track.height + 2*SLIDER_HANDLE};
+
+	if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
+		if(CheckCollisionPointRec(mouse, grab)){
+			//grab whichever handle is closer
+			float d_bottom = fabsf(mouse.y - slider_y(ls, f->z_min));
+			float d_top = fabsf(mouse.y - slider_y(ls, f->z_max));
+			ls->dragging = d_bottom < d_top ? 1 : 2;
+		}
+		for(int t=0; t<4; t++){
+			if(CheckCollisionPointRec(mouse, slider_type_box(t))){
+				f->types ^= 1 << t;
+				changed = true;
+			}
+		}
+	}
+	if(!IsMouseButtonDown(MOUSE_LEFT_BUTTON)) ls->dragging = 0;
+
+	if(ls->dragging){
+		float z = slider_z(ls, mouse.y);
+		if(ls->dragging == 1 && z != f->z_min){
+			f->z_min = z < f->z_max ? z : f->z_max;
+			changed = true;
+		}
+		if(ls->dragging == 2 && z != f->z_max){
+			f->z_max = z > f->z_min ? z : f->z_min;
+			changed = true;
+		}
+	}
+
+	if(tp && tp->layer_count > 0 && (IsKeyPressed(KEY_PAGE_UP) || IsKeyPressed(KEY_PAGE_DOWN))){
+		bool bottom = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+		float *z = bottom ? &f->z_min : &f->z_max;
+		int layer = toolpath_layer(tp, *z);
+		if(tp->layers[layer] < *z - LAYER_TOLERANCE && IsKeyPressed(KEY_PAGE_DOWN)) layer++;	//between layers, the one below counts as the next step down
+		layer += IsKeyPressed(KEY_PAGE_UP) ? 1 : -1;
+		if(layer < 0) layer = 0;
+		if(layer >= tp->layer_count) layer = tp->layer_count - 1;
+		*z = tp->layers[layer];
+		if(f->z_min > f->z_max){
+			if(bottom) f->z_max = f->z_min;
+			else f->z_min = f->z_max;
+		}
+		changed = true;
+	}
+
+	ls->captured = ls->dragging || CheckCollisionPointRec(mouse, grab) || CheckCollisionPointRec(mouse, (Rectangle){track.x, track.y + track.height, track.width, 4*24 + SLIDER_MARGIN});
+	return changed;
+}
+
+void DrawLayerSlider(LayerSlider *ls, PathFilter *f, bool dark_mode){
+	Color fg = dark_mode ? LIGHTGRAY : DARKGRAY;
+	Rectangle track = slider_track();
+	int x = track.x + track.width/2;
+
+	DrawRectangle(x - 2, track.y, 4, track.height, Fade(fg, 0.3f));
+
+	int y_min = slider_y(ls, f->z_min), y_max = slider_y(ls, f->z_max);
+	DrawRectangle(x - 2, y_max, 4, y_min - y_max, fg);
+	DrawRectangle(track.x, y_max - SLIDER_HANDLE/2, track.width, SLIDER_HANDLE, YELLOW);
+	DrawRectangle(track.x, y_min - SLIDER_HANDLE/2, track.width, SLIDER_HANDLE, YELLOW);
+
+	//z in gcode units next to the handles
+	const char *top = TextFormat("Z%.3f", f->z_max/scale);
+	DrawText(top, track.x - MeasureText(top, 10) - 4, y_max - 5, 10, fg);
+	const char *bottom = TextFormat("Z%.3f", f->z_min/scale);
+	DrawText(bottom, track.x - MeasureText(bottom, 10) - 4, y_min - 5, 10, fg);
+
+	for(int t=0; t<4; t++){
+		Rectangle box = slider_type_box(t);
+		bool on = f->types & (1 << t);
+		if(on) DrawRectangleRec(box, Fade(fg, 0.3f));
+		DrawRectangleLines(box.x, box.y, box.width, box.height, fg);
+		DrawText(type_names[t], box.x + (box.width - MeasureText(type_names[t], 10))/2, box.y + 5, 10, on ? fg : Fade(fg, 0.4f));
+	}
+}
+
+#endif //LAYER_SLIDER_H
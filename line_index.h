@@ -0,0 +1,158 @@
+//maps every path segment back to the gcode line (and byte offset) that produced it
+//entries are stored as varint deltas with an absolute checkpoint every LINE_INDEX_STRIDE segments,
+//this keeps the overhead at 1-2 bytes per move while any segment can still be looked up quickly
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "gcode_stream.h"
+
+#define LINE_INDEX_STRIDE 64	//segments between absolute checkpoints
+
+typedef struct LineCheckpoint{
+	uint32_t line;	//absolute line number of the segment (1 based, 0 for the origin)
+	uint32_t pos;	//where the deltas following this checkpoint start
+	uint64_t offset;	//absolute byte offset of that line in the file
+}LineCheckpoint;
+
+typedef struct LineIndex{
+	uint8_t *deltas;	//one or two varints per segment that is not a checkpoint
+	uint32_t deltas_len;
+	uint32_t deltas_cap;
+	LineCheckpoint *checkpoints;
+	int checkpoints_cap;
+	int count;	//number of segments recorded
+	uint32_t last_line;
+	uint64_t last_offset;
+}LineIndex;
+
+static void line_index_put_varint(LineIndex *idx, uint64_t v){
+	if(idx->deltas_len + 10 > idx->deltas_cap){
+		idx->deltas_cap = idx->deltas_cap ? idx->deltas_cap*2 : 4096;
+		idx->deltas = (uint8_t *)realloc(idx->deltas, idx->deltas_cap);
+		if(idx->deltas == NULL){
+			perror("Could not allocate more space for the line index!");
+			exit(-1);
+		}
+	}
+	while(v >= 0x80){
+		idx->deltas[idx->deltas_len++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	idx->deltas[idx->deltas_len++] = (uint8_t)v;
+}
+
+static uint64_t line_index_get_varint(const uint8_t *p, uint32_t *pos){
+	uint64_t v = 0;
+	int shift = 0;
+	uint8_t b;
+	do{
+		b = p[(*pos)++];
+		v |= (uint64_t)(b & 0x7f) << shift;
+		shift += 7;
+	}while(b & 0x80);
+	return v;
+}
+
+//record the source of the next segment, must be called once for every segment in order
+void line_index_push(LineIndex *idx, uint32_t line, uint64_t offset){
+	if(idx->count % LINE_INDEX_STRIDE == 0){
+		int cp = idx->count / LINE_INDEX_STRIDE;
+		if(cp == idx->checkpoints_cap){
+			idx->checkpoints_cap = idx->checkpoints_cap ? idx->checkpoints_cap*2 : 256;
+			idx->checkpoints = (LineCheckpoint *)realloc(idx->checkpoints, sizeof(LineCheckpoint)*idx->checkpoints_cap);
+			if(idx->checkpoints == NULL){
+				perror("Could not allocate more space for the line index!");
+				exit(-1);
+			}
+		}
+		idx->checkpoints[cp].line = line;
+		idx->checkpoints[cp].offset = offset;
+		idx->checkpoints[cp].pos = idx->deltas_len;
+	}
+	else{
+		//lines only move forward, a new line always starts at a new offset and the same line at the same one,
+		//so the common "next line" case needs only the offset delta, the low bit flags a bigger line jump
+		uint64_t d_offset = offset - idx->last_offset;
+		uint32_t d_line = line - idx->last_line;
+		line_index_put_varint(idx, d_offset << 1 | (d_line > 1));
+		if(d_line > 1) line_index_put_varint(idx, d_line);
+	}
+	idx->last_line = line;
+	idx->last_offset = offset;
+	idx->count++;
+}
+
+//look up the line and byte offset that produced segment seg, returns false if out of range
+bool line_index_get(const LineIndex *idx, int seg, uint32_t *line, uint64_t *offset){
+	if(seg < 0 || seg >= idx->count) return false;
+
+	const LineCheckpoint *cp = &idx->checkpoints[seg / LINE_INDEX_STRIDE];
+	uint32_t l = cp->line;
+	uint64_t o = cp->offset;
+	uint32_t pos = cp->pos;
+
+	for(int i = seg % LINE_INDEX_STRIDE; i > 0; i--){
+		uint64_t v = line_index_get_varint(idx->deltas, &pos);
+		uint64_t d_offset = v >> 1;
+		o += d_offset;
+		if(v & 1) l += (uint32_t)line_index_get_varint(idx->deltas, &pos);
+		else if(d_offset) l++;
+	}
+
+	if(line) *line = l;
+	if(offset) *offset = o;
+	return true;
+}
+
+//find the first segment produced by a line at or after the requested one, -1 if there is none
+int line_index_find(const LineIndex *idx, uint32_t line){
+	if(idx->count == 0) return -1;
+
+	//checkpoints are sorted by line, so binary search for the last one before the target
+	int lo = 0, hi = (idx->count - 1) / LINE_INDEX_STRIDE;
+	while(lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if(idx->checkpoints[mid].line < line) lo = mid;
+		else hi = mid - 1;
+	}
+
+	for(int seg = lo * LINE_INDEX_STRIDE; seg < idx->count; seg++){
+		uint32_t l;
+		line_index_get(idx, seg, &l, NULL);
+		if(l >= line) return seg;
+	}
+	return -1;
+}
+
+//lazily read a source line back from the file, the index never keeps the text itself
+//compressed files are inflated from the start up to the line, fine for one line on a key press
+bool line_index_read_line(const char *file, uint64_t offset, char *buf, int size){
+	if(gcode_stream_is_live(file)) return false;	//a pipe can only be read once
+	GcodeStream *f = gcode_stream_open(file);
+	if(f == NULL) return false;
+
+	bool ok = gcode_stream_skip(f, offset) && gcode_stream_gets(f, buf, size) != NULL;
+	gcode_stream_close(f);
+	if(!ok) return false;
+
+	//drop the line ending so it can be drawn on screen
+	for(char *c = buf; *c; c++){
+		if(*c == '\r' || *c == '\n'){
+			*c = '\0';
+			break;
+		}
+	}
+	return true;
+}
+
+void line_index_free(LineIndex *idx){
+	free(idx->deltas);
+	free(idx->checkpoints);
+	*idx = (LineIndex){0};
+}
+
+#endif //LINE_INDEX_H
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200112L	//clock_gettime for the profiler and fseeko for the page file, -std=c99 hides them otherwise
+#define _FILE_OFFSET_BITS 64	//page files of big programs go past 2GB on 32 bit systems
 #include "raylib.h"
 #include <math.h>
 #include <string.h>
@@ -5,43 +7,51 @@
 #define RLIGHTS_IMPLEMENTATION
 #include "rlights.h"
 #include "stl_loader.h"
+#include "line_index.h"
+#include "gcode.h"
+#include "toolpath.h"
+#include "session.h"
+#include "diff.h"
+#include "rapids.h"
+#include "layer_slider.h"
+#include "render.h"
 //#define DEBUG_MODE
 #include "settings.h"
 #include "util.h"	// this should be the last include
 
-//macros
-#define BLEND_FACTOR   150	//0-255 where 255 is no blending and 0 is no color
-#define TRAVEL_COLOR   (Color){255, 0, 0, BLEND_FACTOR} // Red
-#define MOVE_COLOR     (Color){0, 255, 0, BLEND_FACTOR} // Green
-#define ARC_COLOR      (Color){0, 0, 255, BLEND_FACTOR} // Blue
-
-//structures
-typedef struct Segment{
-	Vector3 point;	//end point for line or center for circle
-	Vector3 center;	//end point for line or center for circle
-	Color color;
-	float radius;	//arc radius
-	float angle;	//arc angle
-	float offset;	//arc quadrant offset
-	float k;	//z step
-	bool arc;
-}Segment;
+//a single selected move and the gcode line behind it
+typedef struct Selection{
+	int segment;	//-1 when nothing is selected
+	bool typing;	//reading a line number to jump to
+	char input[12];
+	uint32_t line;
+	char text[256];	//source text of the selected line, read from the file on demand
+}Selection;
 
 //globals 
-Color model_color = {187, 35, 255, 255};
 float scale = 0.10f;
+float rapid_rate = RAPID_RATE;
+Kinematics kinematics = { .model = KIN_TABLE_TABLE, .max_step = 1.0f };
 
 Settings_t settings = {
 	.show_origin = true,
 	.show_grid = true,
 	.show_model = true,
 	.camera_ortho = false,
-	.dark_mode = true
+	.dark_mode = true,
+	.color_by_file = false,
+	.show_filter = true,
+	.show_profiler = false,
+	.show_model_info = false,
+	.color_mode = COLOR_BY_TYPE,
+	.colormap = 0
 };
 
 //prototypes
-int parse_gcode(char *gcode_file, Segment **output);
-void DrawGcodePath(Segment * seg, int len);
+void SelectSegment(Selection *sel, int seg, Toolpath *tp);
+void CheckSelectionInputs(Selection *sel, Camera *camera, Toolpath *tp, DiffSide *changes);
+void DrawSelection(Selection *sel, Toolpath *tp);
+void DrawSelectionText(Selection *sel);
 void DrawOrigin();
 
 int main(int argc, char *argv[]) {
@@ -51,25 +61,219 @@ int main(int argc, char *argv[]) {
 		exit(-1);
 	}
 
-	char * gcode_file = NULL;
-	char * model_file = NULL;
+	Session session = {0};
+	int active = 0;	//the toolpath moves get selected in
 	bool msaa = false;
+	bool diff_mode = false;
+	bool diff_summary = false;	//print the differences and exit without a window
+	bool check_arcs = false;	//check the arc math on made up arcs and those of the programs, then exit
+	bool stl_check_only = false;	//print what the stl check finds in the models and exit
+	bool rapid_report = false;	//print how much time goes on rapids and air cuts and exit
+	char *reorder_file = NULL;	//write the program with its islands reordered there
+	char *render_dir = NULL;	//render previews into this directory instead of opening a window
+	int render_size = 512;
+	int view_flags = VIEW_ISO | VIEW_TOP | VIEW_FRONT;
+	char *trace_file = NULL;	//chrome trace of everything the profiler saw, written on exit
 
 	for(int i=1; i<argc; i++){
-		if(strstr(argv[i], ".stl")) model_file = argv[i];
-		if(strstr(argv[i], ".nc") || strstr(argv[i], ".gc") || strstr(argv[i], ".ngc") || strstr(argv[i], ".gcode")) gcode_file = argv[i];
+		if(strcmp(argv[i], "--render") == 0 && i+1 < argc){
+			render_dir = argv[++i];
+			continue;
+		}
+		if(strcmp(argv[i], "--size") == 0 && i+1 < argc){
+			render_size = atoi(argv[++i]);
+			continue;
+		}
+		if(strcmp(argv[i], "--trace") == 0 && i+1 < argc){
+			trace_file = argv[++i];
+			continue;
+		}
+		if(strcmp(argv[i], "--views") == 0 && i+1 < argc){
+			view_flags = parse_render_views(argv[++i]);
+			if(!view_flags){
+				printf("Unknown view in \"%s\", use iso, top and front\n", argv[i]);
+				exit(-1);
+			}
+			continue;
+		}
+
+		if(strcmp(argv[i], "--kinematics") == 0 && i+1 < argc){
+			if(!parse_kinematics_model(argv[++i], &kinematics)){
+				printf("Unknown kinematics \"%s\", use table-table or head-table\n", argv[i]);
+				exit(-1);
+			}
+			continue;
+		}
+		if(strcmp(argv[i], "--pivot") == 0 && i+1 < argc){
+			Vector3 pivot;
+			if(sscanf(argv[++i], "%f,%f,%f", &pivot.x, &pivot.y, &pivot.z) != 3){
+				printf("Invalid pivot \"%s\", use x,y,z\n", argv[i]);
+				exit(-1);
+			}
+			kinematics.pivot = Vector3Scale(pivot, scale);
+			continue;
+		}
+		if(strcmp(argv[i], "--head-length") == 0 && i+1 < argc){
+			kinematics.head_length = atof(argv[++i])*scale;
+			continue;
+		}
+		if(strcmp(argv[i], "--ooc-budget") == 0 && i+1 < argc){
+			double mb = strtod(argv[++i], NULL);
+			if(mb <= 0){
+				printf("Invalid out of core budget %s, give it in MB\n", argv[i]);
+				exit(-1);
+			}
+			session.ooc_budget = (size_t)(mb*1024*1024);
+			continue;
+		}
+		if(strcmp(argv[i], "--rapid-rate") == 0 && i+1 < argc){
+			rapid_rate = atof(argv[++i]);
+			if(rapid_rate <= 0){
+				printf("Invalid rapid rate %s\n", argv[i]);
+				exit(-1);
+			}
+			continue;
+		}
+		if(strcmp(argv[i], "--reorder") == 0 && i+1 < argc){
+			reorder_file = argv[++i];
+			rapid_report = true;
+			continue;
+		}
+		if(strcmp(argv[i], "--rotary-step") == 0 && i+1 < argc){
+			kinematics.max_step = atof(argv[++i]);
+			if(kinematics.max_step <= 0){
+				printf("Invalid rotary step %s\n", argv[i]);
+				exit(-1);
+			}
+			continue;
+		}
+
+		if(strstr(argv[i], ".stl")) session_add_model(&session, argv[i]);
+		else if(gcode_stream_is_live(argv[i])) session_add_gcode(&session, argv[i]);
+		else if(strstr(argv[i], ".nc") || strstr(argv[i], ".gc") || strstr(argv[i], ".ngc") || strstr(argv[i], ".gcode")) session_add_gcode(&session, argv[i]);
 		if(strstr(argv[i], "--msaa")) msaa = true;
+		if(strcmp(argv[i], "--compact") == 0) session.compact = true;
+		if(strcmp(argv[i], "--diff") == 0) diff_mode = true;
+		if(strcmp(argv[i], "--diff-summary") == 0) diff_mode = diff_summary = true;
+		if(strcmp(argv[i], "--check-arcs") == 0) check_arcs = true;
+		if(strcmp(argv[i], "--stl-check") == 0) stl_check_only = true;
+		if(strcmp(argv[i], "--rapids") == 0) rapid_report = true;
+	}
+
+	profiler_init(trace_file != NULL);
+
+	//with several programs open the file colors are what tells them apart
+	settings.color_by_file = session.toolpath_count > 1 && !diff_mode;
+
+	if(render_dir && diff_mode){
+		printf("--render and --diff can not be used together\n");
+		exit(-1);
+	}
+	if(session.ooc_budget && (render_dir || diff_mode)){
+		printf("--ooc-budget only works in the window, not with --render or --diff\n");
+		exit(-1);
+	}
+	if(rapid_report && (render_dir || diff_mode || session.ooc_budget)){
+		printf("--rapids can not be used with --render, --diff or --ooc-budget\n");
+		exit(-1);
+	}
+	if(reorder_file && session.toolpath_count != 1){
+		printf("--reorder needs exactly one gcode file\n");
+		exit(-1);
+	}
+	if(render_dir && stl_check_only){
+		printf("--render and --stl-check can not be used together\n");
+		exit(-1);
+	}
+	if(render_dir && render_size <= 0){
+		printf("Invalid render size %d\n", render_size);
+		exit(-1);
+	}
+
+	session.stream = !render_dir && !diff_mode && !rapid_report;	//the other modes need whole programs
+	session.check_models = stl_check_only || (!render_dir && !diff_summary && !check_arcs && !rapid_report);
+	if(!render_dir) session_parse(&session);	//rendering parses the programs a few at a time
+
+	if(check_arcs){
+		ArcBatch arcs = {0};
+		int count = arc_batch_random(&arcs, 0, 100000);
+		for(int i=0; i<session.toolpath_count; i++){
+			Toolpath *tp = &session.toolpaths[i];
+			count = gcode_gather_arcs(tp->path, 1, tp->len, &arcs, count);
+		}
+		bool ok = arc_check(&arcs, count);
+		arc_batch_free(&arcs);
+		session_free(&session);
+		return ok ? 0 : 1;
+	}
+
+	if(stl_check_only){
+		bool ok = true;
+		for(int i=0; i<session.model_count; i++){
+			stl_report_print(session.models[i].file, &session.models[i].report);
+			ok = ok && stl_report_ok(&session.models[i].report);
+		}
+		session_free(&session);
+		if(trace_file) profiler_write_trace(trace_file);
+		return ok ? 0 : 1;
+	}
+
+	if(rapid_report){
+		bool ok = true;
+		for(int i=0; i<session.toolpath_count; i++){
+			Toolpath *tp = &session.toolpaths[i];
+			size_t text_len;
+			char *text = rapid_read_source(tp->file, &text_len);
+			RapidReport report;
+			PROFILE("rapids") report = rapid_analyze(tp->path, tp->len, &tp->lines, text, text_len, rapid_rate, 0);
+			rapid_report_print(tp->file, &report);
+			if(reorder_file){
+				ok = rapid_write(reorder_file, &report, tp->path, &tp->lines, text, text_len);
+				if(ok) printf("Reordered program written to %s\n", reorder_file);
+			}
+			rapid_report_free(&report);
+			free(text);
+		}
+		session_free(&session);
+		if(trace_file) profiler_write_trace(trace_file);
+		return ok ? 0 : 1;
+	}
+
+	Diff diff = {0};
+	if(diff_mode){
+		if(session.toolpath_count != 2){
+			printf("Diff mode needs exactly two gcode files, old and new\n");
+			exit(-1);
+		}
+		Toolpath *old = &session.toolpaths[0], *new = &session.toolpaths[1];
+		PROFILE("diff") diff = diff_paths(old->path, old->len, new->path, new->len);
+		diff_print_summary(&diff, old->file, &old->lines, new->file, &new->lines, diff_summary ? 1000 : 20);
+
+		if(diff_summary){
+			int differ = diff.same != diff.a.count || diff.same != diff.b.count;
+			diff_free(&diff);
+			session_free(&session);
+			if(trace_file) profiler_write_trace(trace_file);
+			return differ;	//like diff, 0 means the programs match
+		}
+		diff_color_paths(&diff, old->path, old->len, new->path, new->len);
+		active = 1;
 	}
 
 	const int screenWidth = 800;
 	const int screenHeight = 450;
 
-	if(msaa)
+	if(render_dir){
+		SetTraceLogLevel(LOG_WARNING);
+		SetConfigFlags(FLAG_WINDOW_HIDDEN);
+		InitWindow(render_size, render_size, "CGinC");
+	}
+	else if(msaa)
 		SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
 	else
 		SetConfigFlags(FLAG_WINDOW_RESIZABLE);
 
-	InitWindow(screenWidth, screenHeight, "CGinC");
+	if(!render_dir) InitWindow(screenWidth, screenHeight, "CGinC");
 
 	// Define the camera to look into our 3d world
 	Camera3D camera = { 0 };
@@ -81,10 +285,6 @@ int main(int argc, char *argv[]) {
 
 	SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
 
-	//Texture texture = LoadTexture("resources/texel_checker.png");
-	Image texture_image = GenImageColor(1.0f, 1.0f, model_color);
-	Texture texture = LoadTextureFromImage(texture_image);
-
 	Shader shader = LoadShader(TextFormat("resources/shaders/glsl%i/base_lighting.vs", GLSL_VERSION), 
 			TextFormat("resources/shaders/glsl%i/lighting.fs", GLSL_VERSION));
 
@@ -99,26 +299,52 @@ int main(int argc, char *argv[]) {
 	Light light = { 0 };
 	light = CreateLight(LIGHT_POINT, (Vector3){ 4, 2, 4 }, Vector3Zero(), WHITE, shader);
 
-	//Model model = LoadModel("bunny.obj");
-	//Model model = LoadModelFromMesh(GenMeshCube(1.0f, 1.0f, 1.0f));
-	Model model;
-	if(model_file){
-		Mesh model_mesh = load_stl(model_file);
-		model = LoadModelFromMesh(model_mesh);
-		//model.transform = MatrixMultiply(model.transform, MatrixRotateX(DEG2RAD*90));
-		model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = texture;
-		model.materials[0].shader = shader;
+	load_path_shaders(GLSL_VERSION);
+
+	if(render_dir){
+		int failed = render_session(&session, render_dir, render_size, view_flags, settings.dark_mode, shader, &light);
+		session_free(&session);
+		unload_path_shaders();
+		CloseWindow();
+		if(trace_file) profiler_write_trace(trace_file);
+		return failed > 0;
 	}
 
+	session_upload(&session, shader);
+
+	Selection selection = { .segment = -1 };
 
-	Segment *path;
-	int path_len = parse_gcode(gcode_file, &path);
+	PathFilter filter;
+	LayerSlider slider = {0};
+	InitLayerSlider(&slider, &filter, session.toolpaths, session.toolpath_count);
 
 
 	while (!WindowShouldClose())    // Detect window close button or ESC key
 	{
-		CheckInputs(&settings);
-		CustomUpdateCamera(&camera, &settings);
+		if(session_poll(&session)){	//a stream ended and now has layers to filter by
+			InitLayerSlider(&slider, &filter, session.toolpaths, session.toolpath_count);
+			for(int i=0; i<session.toolpath_count; i++) toolpath_filter(&session.toolpaths[i], &filter);
+		}
+
+		if(!selection.typing){
+			CheckInputs(&settings);
+			CheckSessionInputs(&session);
+			if(IsKeyPressed(KEY_TAB) && session.toolpath_count > 0){
+				active = (active + 1) % session.toolpath_count;
+				selection.segment = -1;
+			}
+		}
+		if(session.toolpath_count > 0){
+			DiffSide *changes = NULL;
+			if(diff_mode) changes = active == 0 ? &diff.a : &diff.b;
+			CheckSelectionInputs(&selection, &camera, &session.toolpaths[active], changes);
+		}
+
+		Toolpath *active_path = session.toolpath_count > 0 ? &session.toolpaths[active] : NULL;
+		if(settings.show_filter && session.toolpath_count > 0 && UpdateLayerSlider(&slider, &filter, active_path)){
+			for(int i=0; i<session.toolpath_count; i++) toolpath_filter(&session.toolpaths[i], &filter);
+		}
+		if(!(settings.show_filter && slider.captured)) PROFILE("camera") CustomUpdateCamera(&camera, &settings);
 
 		static bool last_camera_ortho = false;
 		if(settings.camera_ortho && !last_camera_ortho){
@@ -151,325 +377,150 @@ int main(int argc, char *argv[]) {
 
 		BeginMode3D(camera);
 
-		if(settings.show_grid)DrawXYGrid(&settings);
-		if(settings.show_origin)DrawOrigin();
+		if(settings.show_grid) PROFILE("draw grid") DrawXYGrid(&settings);
+		if(settings.show_origin) PROFILE("draw origin") DrawOrigin();
 
-		DrawGcodePath(path, path_len);
-		//free(path);
-		//parse_gcode(gcode_file, &path);
+		PathColoring coloring = { .mode = settings.color_mode, .colormap = settings.colormap };
+		session_value_range(&session, &coloring);
 
-		if(model_file && settings.show_model)DrawModel(model, (Vector3){ 0.0f, 0.0f, 0.0f }, scale, GRAY);   // Draw 3d model with texture
+		PROFILE("draw path"){
+			for(int i=0; i<session.toolpath_count; i++){
+				Toolpath *tp = &session.toolpaths[i];
+				if(tp->ooc) DrawOocToolpath(tp, settings.color_by_file ? 0.8f : 0.0f, &coloring);
+				else DrawToolpath(tp, settings.color_by_file ? 0.8f : 0.0f, &coloring);
+			}
+			if(session.toolpath_count > 0) DrawSelection(&selection, &session.toolpaths[active]);
+		}
+
+		PROFILE("draw model") for(int i=0; i<session.model_count; i++){
+			ModelFile *m = &session.models[i];
+			if(settings.show_model && m->visible) DrawModelFile(m, GRAY);   // Draw 3d model with texture
+		}
 		//DrawModelWires(model, (Vector3){ 0.0f, 0.0f, 0.0f }, scale, BLACK);   // Draw 3d model with texture
 
 		EndMode3D();
 
-		DEBUG_SHOW(DrawFPS(10, 10);)
+		DrawSessionLegend(&session, active);
+		if(settings.show_filter && session.toolpath_count > 0) DrawLayerSlider(&slider, &filter, settings.dark_mode);
+		DrawSelectionText(&selection);
+		DrawColorLegend(&coloring, settings.dark_mode);
+		if(settings.show_profiler) DrawProfiler(settings.dark_mode);
+		if(settings.show_model_info) DrawModelReports(&session, settings.dark_mode);
 
-		EndDrawing();
+		PROFILE("present") EndDrawing();
+		profiler_frame();
 	}
 
-	free(path);
-	if(model_file){
-		UnloadModel(model);
-		UnloadTexture(texture);
-	}
+	diff_free(&diff);
+	session_free(&session);
+	unload_path_shaders();
 
 	CloseWindow();        // Close window and OpenGL context
 
+	if(trace_file) profiler_write_trace(trace_file);
+
 	return 0;
 }
 
-int parse_gcode(char *gcode_file, Segment **output){
-
-	printf("Parsing Gcode\n");
-
-	FILE *g = fopen(gcode_file, "r");
-	if(g == NULL){
-		printf("Gcode file: \"%s\" does not exist!", gcode_file);
-		exit(-1);
-	}
-
-	int seg_block = 1024;
-	int seg_index = 0;
-
-	Segment * segments = (Segment *)malloc(sizeof(Segment)*seg_block);
-
-	segments[seg_index].point.x = 0;
-	segments[seg_index].point.y = 0;
-	segments[seg_index].point.z = 0;
-	segments[seg_index].color = BLACK;
+//the segment after an arc only marks where the arc ended, it is not a move of its own
+static bool is_move(Toolpath *tp, int i){
+	return i > 0 && i < tp->len && !tp->path[i-1].arc;
+}
 
-	char *line, *line_alloc = (char *)malloc(1024);
-	line = line_alloc;
+void SelectSegment(Selection *sel, int seg, Toolpath *tp){
+	if(seg < 1 || seg >= tp->len) return;
 
-	Vector3 last_position = {0,0,0};
-	Vector3 l_end = {0,0,0};
-	Color l_color;
+	uint64_t offset;
+	sel->segment = seg;
+	sel->text[0] = '\0';
+	if(!line_index_get(&tp->lines, seg, &sel->line, &offset)) return;
 
-	bool absolute = true;
-	
-	while(1){	//go through all the lines
-		
+	if(!line_index_read_line(tp->file, offset, sel->text, sizeof(sel->text)))
+		snprintf(sel->text, sizeof(sel->text), "<could not read line>");
 
-		if(fgets(line, 1023, g) == NULL){
-			printf("No string read!\n");
-			break;	//read line
-		}
-		
-		if(feof(g)){
-			printf("EOF Reached\n");
-			break;
-		}
+	printf("Segment %d, line %u: %s\n", seg, sel->line, sel->text);
+}
 
-		char *end = NULL;
-		end = strchr(line, ';');	//find end of gcode command
-		if(end != NULL) *end = '\0';	//terminate string there
-
-		char* c = strchr(line, 'G');	//look for g command in line
-		if(c != NULL) line = c;	//start intepreting from there
-		else continue;	//or abort/ nothing for us to draw
-
-
-		while(line != NULL){		//interpret all gcode command in line
-			int cmd = strtol(line+1, &line, 10);
-		
-			switch(cmd){
-			case 90:	//absolute mode
-				absolute = true;
-				break;
-			case 91:	//incremental mode
-				absolute = false;
-				break;
-			case 0:		//rapid
-				l_color = TRAVEL_COLOR;
-				break;
-			case 1:		//feed
-				l_color = MOVE_COLOR;
-				break;
-			case 2:	//clockwise arc
-			case 3:	//counterclockwise arc
-				l_color = ARC_COLOR;
-				break;
-			default:
-				break;
-			}
+//jump to a move and bring it into the middle of the view
+static void FocusSegment(Selection *sel, Camera *camera, Toolpath *tp, int seg){
+	SelectSegment(sel, seg, tp);
 
-			if(cmd == 91 || cmd == 90) {	//these just change the coordinate system
-				char *tmp = strchr(line, 'G');
-				if(tmp != NULL) line = tmp;
-				continue;	//go to top of loop
-			}
+	Vector3 shift = Vector3Subtract(tp->path[seg].point, camera->target);
+	camera->target = Vector3Add(camera->target, shift);
+	camera->position = Vector3Add(camera->position, shift);
+}
 
-			//ignore feed
-			char *f_pos = strchr(line, 'F');
-			if(f_pos != NULL){
-				char *skip_to = strchr(f_pos, ' ');
-				if(skip_to != NULL) strcpy(f_pos, skip_to);
-				else break;
-				printf("here %s\n", line);
-			}
+//changes is only set in diff mode, n then jumps to the next difference
+void CheckSelectionInputs(Selection *sel, Camera *camera, Toolpath *tp, DiffSide *changes){
+	//out of core the path only holds the outline, one move in OOC_OUTLINE_STEP, and the lines of the others are not kept
+	if(tp->ooc){
+		if(IsKeyPressed(KEY_J) || IsKeyPressed(KEY_RIGHT) || IsKeyPressed(KEY_LEFT))
+			printf("Moves can not be selected in %s, it is kept out of core with --ooc-budget\n", tp->file);
+		return;
+	}
 
-			float x,y,z;	//get coordinates
-			char *x_pos = strchr(line, 'X');
-			char *y_pos = strchr(line, 'Y');
-			char *z_pos = strchr(line, 'Z');
-			char *i_pos = strchr(line, 'I');
-			char *j_pos = strchr(line, 'J');
-			char *k_pos = strchr(line, 'K');
-			char *r_pos = strchr(line, 'R');
-
-			//check if axis gets moved
-			if(x_pos != NULL) x = strtof(x_pos+1, NULL)*scale;	//check if value present and get it
-			else if(cmd != 2 && cmd != 3) x = last_position.x;	//if its not and we are not in arc
-			else x = 0;	//if its not and we are in arc
-
-			if(y_pos != NULL) y = strtof(y_pos+1, NULL)*scale;
-			else if(cmd != 2 && cmd != 3) y = last_position.y;
-			else y = 0;
-
-			if(z_pos != NULL) z = strtof(z_pos+1, NULL)*scale;
-			else if(cmd != 2 && cmd != 3) z = last_position.z;
-			else z = 0;
-
-			if(absolute){	//this means we go to x
-				l_end.x = x;
-				l_end.y = y;
-				l_end.z = z;
+	if(sel->typing){
+		int n = strlen(sel->input);
+		int c;
+		while((c = GetCharPressed()) != 0){
+			if(c >= '0' && c <= '9' && n < (int)sizeof(sel->input) - 1){
+				sel->input[n++] = c;
+				sel->input[n] = '\0';
 			}
-			else{		//this means we go x amount from where we are
-				l_end.x += x;
-				l_end.y += y;
-				l_end.z += z;
+		}
+		if(IsKeyPressed(KEY_BACKSPACE) && n > 0) sel->input[--n] = '\0';
+		if(IsKeyPressed(KEY_J)) sel->typing = false;	//cancel
+		if(IsKeyPressed(KEY_ENTER)){
+			sel->typing = false;
+			int seg = line_index_find(&tp->lines, strtoul(sel->input, NULL, 10));
+			while(seg > 0 && seg < tp->len && !is_move(tp, seg)) seg++;
+			if(seg < 1 || seg >= tp->len){
+				printf("No moves at or after line %s\n", sel->input);
+				return;
 			}
+			FocusSegment(sel, camera, tp, seg);
+		}
+		return;
+	}
 
-			//allocate more segments if needed
-			if(seg_index == seg_block-1){
-				seg_block += 1024;
-				segments = (Segment *)realloc(segments, sizeof(Segment)*seg_block);
-					printf("Reallocing new size = %0.1fK\n", seg_block/1024.0);
-				if(segments == NULL){
-					perror("Could not allocate more space for segments!");
-					exit(-1);
-				}
-			}
+	if(changes && IsKeyPressed(KEY_N)){
+		int seg = diff_next_change(changes, sel->segment);
+		if(seg < 0) seg = diff_next_change(changes, 0);	//wrap around
+		if(seg > 0) FocusSegment(sel, camera, tp, seg);
+		else printf("No differences in %s\n", tp->file);
+	}
 
-			if(cmd == 2 || cmd == 3){	//arc
-
-				Vector3 center;
-
-				float i,j,k;
-
-				if(i_pos != NULL) i = strtof(i_pos+1, NULL)*scale;
-				else i = 0;
-				if(j_pos != NULL) j = strtof(j_pos+1, NULL)*scale;
-				else j = 0;
-				if(k_pos != NULL) k = strtof(k_pos+1, NULL)*scale;
-				else k = 0;
-
-
-				//if(l_end.z == last_position.z) u.z = 0;
-				float radius;
-				if(r_pos != NULL){
-					radius = strtof(r_pos+1, NULL)*scale;
-					//trying to implement radius mode
-					//for any angle between the start of the arc and the end of it
-					//the center will lie on the tangent
-					float q = sqrt((l_end.x-last_position.x)*(l_end.x-last_position.x) + (l_end.y-last_position.y)*(l_end.y-last_position.y));
-
-					float y3 = (last_position.y+l_end.y)/2;
-					float x3 = (last_position.x+l_end.x)/2;
-
-					float basex = sqrt( radius*radius - q*q/4.0 ) * (last_position.y-l_end.y)/q; //calculate once
-					float basey = sqrt( radius*radius - q*q/4.0 ) * (l_end.x-last_position.x)/q; //calculate once
-
-					if(cmd == 3){
-						center.x = x3 + basex; //center x of circle 1
-						center.y = y3 + basey; //center y of circle 1
-					}
-					else {
-						center.x = x3 - basex; //center x of circle 2
-						center.y = y3 - basey; //center y of circle 2
-					}
-
-					center.z = last_position.z;
-				}
-				else{
-					if(absolute){
-						center.x = i;
-						center.y = j;
-						center.z = k;
-					}
-					else{
-						center.x = last_position.x + i;
-						center.y = last_position.y + j;
-						center.z = last_position.z + k;
-					}
-				}
-
-				if(z_pos == NULL) l_end.z = last_position.z;
-
-				//calculate the vectors from the center
-				Vector3 v, u;
-				v.x = last_position.x - center.x;
-				v.y = last_position.y - center.y;
-				v.z = last_position.z - center.z;
-				//printVector3("v", v);
-
-				u.x = l_end.x - center.x;
-				u.y = l_end.y - center.y;
-				u.z = l_end.z - center.z;
-				//printVector3("u", u);
-
-				if(r_pos == NULL){
-					//calculate the radius
-					//radius = sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
-					radius = 1.0f / Q_rsqrt(v.x*v.x + v.y*v.y + v.z*v.z);
-				}
-
-				float rotationAngle;	//this angle can be calculated from the definition of the vector dot product
-
-				if(l_end.x == last_position.x && l_end.y == last_position.y){
-					//if the end point is the same as the starting point assume full circle
-					rotationAngle = 360;
-				}
-				else {
-					float v_dot_u = v.x*u.x + v.y*u.y + v.z*u.z;
-					//For the gcode to be valid, the magnitudes of both vectors should be equal, or close enough
-					//I will check it for the user
-					//float mag_v = radius;	 //the radius is the first magnitude
-					float mag_v = 1.0f / Q_rsqrt(v.x*v.x + v.y*v.y + v.z*v.z);
-
-					//float mag_u  = sqrt(u.x*u.x + u.y*u.y + u.z*u.z);
-					float mag_u  = 1.0f / Q_rsqrt(u.x*u.x + u.y*u.y + u.z*u.z);
-
-					if(fast_abs(mag_v - mag_u) > 0.01) printf("Something's fishy about that arc, check it again\n");
-
-					//finally we can calculate the angle
-					rotationAngle = RAD2DEG*acos(v_dot_u / (mag_v * mag_u));
-				}
-
-				//use the angle of the vector to x axis to offset the start of the section
-				float offsetAngle = atan2(v.x, v.y)*RAD2DEG -180;
-
-				if(cmd == 2){
-					rotationAngle = -rotationAngle;	//use negative angle to rotate backwards
-					offsetAngle = offsetAngle+180;	//this now needs to be also offset
-				}
-
-				//printf("X%f Y%f Z%f I%f J%f K%f R%f A%f O%f\n", l_end.x, l_end.y, l_end.z, center.x, center.y, center.z, radius, rotationAngle, offsetAngle);
-
-				//printVector3("last_position", last_position);
-				//printVector3("l_end", l_end);
-				//printVector3("center", center);
-				//DrawCircleSector3D(center, radius, rotationAngle, offsetAngle, u.z, l_color);
-				seg_index++;
-				segments[seg_index].point.x = l_end.x;
-				segments[seg_index].point.y = l_end.y;
-				segments[seg_index].point.z = l_end.z;
-				segments[seg_index].center.x = center.x;
-				segments[seg_index].center.y = center.y;
-				segments[seg_index].center.z = center.z;
-				segments[seg_index].color = l_color;
-				segments[seg_index].radius = radius;
-				segments[seg_index].angle = rotationAngle;
-				segments[seg_index].offset = offsetAngle;
-				segments[seg_index].k = u.z;
-				segments[seg_index].arc = true;
-			}
-			else {
-				//DrawLine3D(last_position, l_end, l_color);
-			}
-			//this is added for the next line too use as start
-			seg_index++;
-			segments[seg_index].point.x = l_end.x;
-			segments[seg_index].point.y = l_end.y;
-			segments[seg_index].point.z = l_end.z;
-			segments[seg_index].color = l_color;
-			segments[seg_index].arc = false;
+	if(IsKeyPressed(KEY_J)){
+		sel->typing = true;
+		sel->input[0] = '\0';
+		while(GetCharPressed() != 0);	//drop the 'j' that started the input
+	}
 
+	int step = 0;
+	if(IsKeyPressed(KEY_RIGHT)) step = 1;
+	if(IsKeyPressed(KEY_LEFT)) step = -1;
+	if(step == 0) return;
 
-			last_position.x = l_end.x;
-			last_position.y = l_end.y;
-			last_position.z = l_end.z;
+	int seg = sel->segment < 0 ? (step > 0 ? 0 : tp->len) : sel->segment;
+	do seg += step; while(seg > 0 && seg < tp->len && !is_move(tp, seg));
+	if(seg > 0 && seg < tp->len) SelectSegment(sel, seg, tp);
+}
 
-			break;	//out of loop
-		}
+void DrawSelection(Selection *sel, Toolpath *tp){
+	if(sel->segment < 1 || !tp->visible) return;
 
+	Segment *s = &tp->path[sel->segment];
+	if(s->arc){	//the same steps the path is tessellated with, so the highlight lies on it
+		int steps = toolpath_segment_lines(s);
+		float start = arc_start(s), step = s->angle/steps;
+		for(int i=0; i<steps; i++) DrawLine3D(arc_point(s, start + i*step), arc_point(s, start + (i + 1)*step), YELLOW);
 	}
-	fclose(g);
-	free(line_alloc);
-
-	*output = segments;
-	seg_index++;  //from index to number of segments
-
-	printf("Parsing Complete, %d points found!\n", seg_index);
-	return seg_index;
+	else DrawLine3D(tp->path[sel->segment-1].point, s->point, YELLOW);
+	DrawSphere(s->point, 0.05f, YELLOW);
 }
 
-void DrawGcodePath(Segment * seg, int len){
-	for(int i=1; i<len; i++){
-		//printf("%d: %f, %f, %f\n", i, seg[i].point.x, seg[i].point.y, seg[i].point.z);
-		if(seg[i].arc) DrawCircleSector3D(seg[i].center, seg[i].radius, seg[i].angle, seg[i].offset, seg[i].k, seg[i].color);
-		else DrawLine3D(seg[i-1].point, seg[i].point, seg[i].color);
-	}
+void DrawSelectionText(Selection *sel){
+	int y = GetScreenHeight() - 30;
+	if(sel->typing) DrawText(TextFormat("Go to line: %s_", sel->input), 10, y, 20, YELLOW);
+	else if(sel->segment > 0) DrawText(TextFormat("%u: %s", sel->line, sel->text), 10, y, 20, YELLOW);
 }
@@ -0,0 +1,402 @@
+//programs too big for memory: the parser hands its segments over after every buffer and they go straight into
+//a page file on disk, cut into chunks that are short runs of the program and stay inside a small box,
+//only a coarse outline of the program and the box of every chunk stay in memory,
+//chunks in view are read back and drawn in full detail while the outline stands in for the rest,
+//the ones drawn least recently are dropped again when the loaded chunks go over the memory budget
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "toolpath.h"
+
+#define OOC_CHUNK_VERTICES 131072	//most path vertices in one chunk, a few MB once loaded
+#define OOC_CHUNK_MIN 4096	//segments a chunk has before it gets closed for the size of its box
+#define OOC_CHUNK_EXTENT 20.0f	//drawing units, a chunk whose box gets wider than this is closed
+#define OOC_OUTLINE_STEP 256	//every this many segments one end point goes in the outline
+#define OOC_LOADS_PER_FRAME 4
+#define OOC_FRAME_TIME 8000.0	//microseconds a frame may spend loading chunks, at least one always gets loaded
+
+typedef struct OocChunk{
+	int64_t first;	//number of its first segment in the program, it starts from where the one before ended
+	double time;	//seconds into the program where it starts
+	int count;
+	int vertices;
+	BoundingBox bounds;
+	int outline_first;	//outline segments that are drawn while it is not loaded
+	int outline_count;
+	Toolpath *detail;	//NULL while it is only on disk
+	size_t bytes;	//memory it takes while loaded
+	uint64_t last_used;	//frame it was last drawn in
+	bool in_view;
+	float depth;	//distance along the view, closer chunks get loaded first
+}OocChunk;
+
+typedef struct OocPath{
+	FILE *pages;	//every segment of the program in order, already deleted so it goes away with the process
+	int64_t segments;	//written so far, the origin is the first
+	double seconds;	//into the program at the end of the last segment written
+	OocChunk *chunks;
+	int chunk_count;
+	int chunk_cap;
+	int outline_cap;
+	bool compact;	//the format chunks are loaded in
+
+	size_t budget;	//bytes the loaded chunks may take
+	size_t used;
+	int loaded;
+	uint64_t frame;
+
+	float value_min[COLOR_MODES];	//over the whole program, the outline only sees some of it
+	float value_max[COLOR_MODES];
+}OocPath;
+
+//the page file goes in $TMPDIR or /var/tmp, /tmp is often in memory which is the thing we are trying to spare
+OocPath *ooc_new(size_t budget, bool compact){
+	OocPath *o = (OocPath *)calloc(1, sizeof(OocPath));
+	if(o == NULL){
+		perror("Could not allocate space for the out of core path!");
+		exit(-1);
+	}
+	o->budget = budget;
+	o->compact = compact;
+	for(int m=0; m<COLOR_MODES; m++){
+		o->value_min[m] = INFINITY;
+		o->value_max[m] = -INFINITY;
+	}
+
+	const char *dir = getenv("TMPDIR");
+	if(dir == NULL || dir[0] == '\0') dir = "/var/tmp";
+	char name[4096];
+	snprintf(name, sizeof(name), "%s/cginc-%d-%p.pages", dir, (int)getpid(), (void *)o);
+	o->pages = fopen(name, "w+b");
+	if(o->pages == NULL){
+		perror("Could not create the page file!");
+		exit(-1);
+	}
+	remove(name);
+	setvbuf(o->pages, NULL, _IOFBF, 1 << 20);
+	return o;
+}
+
+static void ooc_add_outline(Toolpath *tp, OocPath *o, Segment *s, LineIndex *lines, int n){
+	if(tp->len + 1 > o->outline_cap){
+		o->outline_cap = o->outline_cap ? o->outline_cap*2 : 4096;
+		tp->path = (Segment *)realloc(tp->path, sizeof(Segment)*o->outline_cap);
+		tp->times = (float *)realloc(tp->times, sizeof(float)*o->outline_cap);
+		if(tp->path == NULL || tp->times == NULL){
+			perror("Could not allocate more space for the outline!");
+			exit(-1);
+		}
+	}
+	uint32_t line = 0;
+	uint64_t offset = 0;
+	line_index_get(lines, n, &line, &offset);
+	line_index_push(&tp->lines, line, offset);
+	tp->times[tp->len] = o->seconds;
+	tp->path[tp->len++] = (Segment){ .point = s->point, .color = s->color, .type = s->type, .feed = s->feed, .spindle = s->spindle };
+}
+
+//the outline of every chunk ends on its last segment, s is that segment
+static void ooc_close_chunk(Toolpath *tp, OocPath *o, Segment *s, LineIndex *lines, int n){
+	OocChunk *c = &o->chunks[o->chunk_count - 1];
+	if(c->count % OOC_OUTLINE_STEP != 0) ooc_add_outline(tp, o, s, lines, n);
+	c->outline_count = tp->len - c->outline_first;
+}
+
+static void ooc_open_chunk(Toolpath *tp, OocPath *o, int64_t first, Vector3 start){
+	if(o->chunk_count == o->chunk_cap){
+		o->chunk_cap = o->chunk_cap ? o->chunk_cap*2 : 256;
+		o->chunks = (OocChunk *)realloc(o->chunks, sizeof(OocChunk)*o->chunk_cap);
+		if(o->chunks == NULL){
+			perror("Could not allocate space for the chunks!");
+			exit(-1);
+		}
+	}
+	o->chunks[o->chunk_count++] = (OocChunk){ .first = first, .time = o->seconds, .bounds = {start, start}, .outline_first = tp->len };
+}
+
+//box of the move ending at s, with the full width of an arc
+static BoundingBox ooc_segment_box(Segment *s, Vector3 start){
+	BoundingBox box = {Vector3Min(start, s->point), Vector3Max(start, s->point)};
+	if(s->arc){
+		Vector3 r = {s->radius, s->radius, fabsf(s->k)};
+		box.min = Vector3Min(box.min, Vector3Subtract(s->center, r));
+		box.max = Vector3Max(box.max, Vector3Add(s->center, r));
+	}
+	return box;
+}
+
+//move the segments the parser holds into the chunks and the page file, the last one stays behind as the start of the next batch
+static void ooc_take_segments(Toolpath *tp, OocPath *o, GcodeParser *p){
+	Segment *seg = p->segments;
+	if(fwrite(seg + 1, sizeof(Segment), p->count - 1, o->pages) != (size_t)(p->count - 1)){
+		perror("Could not write to the page file!");
+		exit(-1);
+	}
+
+	for(int n=1; n<p->count; n++){
+		int64_t number = o->segments + n - 1;
+		Segment *s = &seg[n];
+		OocChunk *c = &o->chunks[o->chunk_count - 1];
+		BoundingBox box = ooc_segment_box(s, seg[n-1].point);
+
+		Vector3 min = Vector3Min(c->bounds.min, box.min), max = Vector3Max(c->bounds.max, box.max);
+		int vertices = toolpath_segment_lines(s)*2;
+		if(c->vertices + vertices > OOC_CHUNK_VERTICES || (c->count >= OOC_CHUNK_MIN && Vector3Distance(min, max) > OOC_CHUNK_EXTENT)){
+			ooc_close_chunk(tp, o, &seg[n-1], p->lines, n - 1);
+			ooc_open_chunk(tp, o, number, seg[n-1].point);
+			c = &o->chunks[o->chunk_count - 1];
+			min = box.min;
+			max = box.max;
+		}
+		c->bounds = (BoundingBox){min, max};
+		c->count++;
+		c->vertices += vertices;
+		o->seconds += move_seconds(seg, n);
+		if(c->count % OOC_OUTLINE_STEP == 0) ooc_add_outline(tp, o, s, p->lines, n);
+
+		float values[COLOR_MODES] = { [COLOR_BY_FEED] = s->feed, [COLOR_BY_SPINDLE] = s->spindle, [COLOR_BY_ORDER] = number, [COLOR_BY_TIME] = o->seconds, [COLOR_BY_Z] = s->point.z };
+		for(int m=COLOR_BY_FEED; m<COLOR_MODES; m++){
+			if(m == COLOR_BY_FEED && s->type == 0) continue;
+			o->value_min[m] = fminf(o->value_min[m], values[m]);
+			o->value_max[m] = fmaxf(o->value_max[m], values[m]);
+		}
+	}
+	o->segments += p->count - 1;
+
+	//start the next batch from the last segment, with the line index of the batch to match
+	seg[0] = seg[p->count - 1];
+	p->count = 1;
+	p->resolved = 1;
+	uint32_t line = 0;
+	uint64_t offset = 0;
+	line_index_get(p->lines, 0, &line, &offset);	//only the origin has to be right, later ones are not looked up again
+	line_index_free(p->lines);
+	*p->lines = (LineIndex){0};
+	line_index_push(p->lines, line, offset);
+}
+
+//parse a program into tp->ooc, tp->path and tp->lines only get the outline
+int ooc_parse_gcode(Toolpath *tp){
+	OocPath *o = tp->ooc;
+	printf("Parsing Gcode out of core\n");
+
+	GcodeStream *g = gcode_stream_open(tp->file);
+	if(g == NULL){
+		printf("Gcode file: \"%s\" does not exist!", tp->file);
+		exit(-1);
+	}
+
+	LineIndex lines = {0};	//of the batch the parser holds
+	GcodeParser parser;
+	gcode_parser_init(&parser, &lines);
+	if(fwrite(&parser.segments[0], sizeof(Segment), 1, o->pages) != 1){
+		perror("Could not write to the page file!");
+		exit(-1);
+	}
+	o->segments = 1;
+	tp->len = 0;
+	ooc_add_outline(tp, o, &parser.segments[0], &lines, 0);
+	ooc_open_chunk(tp, o, 1, parser.segments[0].point);
+
+	char *buf = (char *)malloc(STREAM_BUFFER_SIZE);
+	if(buf == NULL){
+		perror("Could not allocate space for reading!");
+		exit(-1);
+	}
+	size_t n;
+	while((n = gcode_stream_read(g, buf, STREAM_BUFFER_SIZE)) > 0){
+		gcode_parser_feed(&parser, buf, n);
+		ooc_take_segments(tp, o, &parser);
+	}
+	gcode_parser_finish(&parser);
+	ooc_take_segments(tp, o, &parser);
+	printf("EOF Reached\n");
+	if(parser.rotary) printf("Rotary axes are drawn as they are out of core, without the kinematics\n");
+
+	//an empty last chunk is dropped
+	if(o->chunks[o->chunk_count - 1].count == 0) o->chunk_count--;
+	else ooc_close_chunk(tp, o, &parser.segments[0], &lines, 0);
+	fflush(o->pages);
+
+	gcode_stream_close(g);
+	free(buf);
+	free(parser.segments);
+	free(parser.rotary);
+	line_index_free(&lines);
+
+	printf("Parsing Complete, %lld points in %d chunks, outline of %d points, %lld MB paged out\n",
+			(long long)o->segments, o->chunk_count, tp->len, (long long)(o->segments*sizeof(Segment) >> 20));
+	return tp->len;
+}
+
+//after the outline is tessellated, its values and layers only cover the points it kept,
+//the lowest and highest z of the program become layers too so the slider spans all of it
+void ooc_upload(Toolpath *tp){
+	OocPath *o = tp->ooc;
+	memcpy(tp->value_min, o->value_min, sizeof(tp->value_min));
+	memcpy(tp->value_max, o->value_max, sizeof(tp->value_max));
+	if(o->value_min[COLOR_BY_Z] > o->value_max[COLOR_BY_Z]) return;
+
+	float *old = tp->layers;
+	float *z = (float *)malloc(sizeof(float)*(tp->layer_count + 3));
+	if(z == NULL){
+		perror("Could not allocate space for the layers!");
+		exit(-1);
+	}
+	memcpy(z, old, sizeof(float)*tp->layer_count);
+	z[tp->layer_count] = o->value_min[COLOR_BY_Z];
+	z[tp->layer_count + 1] = o->value_max[COLOR_BY_Z];
+	qsort(z, tp->layer_count + 2, sizeof(float), compare_float);
+	int count = 0;
+	for(int i=0; i<tp->layer_count + 2; i++) if(count == 0 || z[i] - z[count-1] > LAYER_TOLERANCE) z[count++] = z[i];
+
+	tp->layers = z;
+	tp->layer_count = count;
+	for(int i=0; i<tp->run_count; i++) tp->runs[i].layer = toolpath_layer(tp, old[tp->runs[i].layer]);
+	free(old);
+}
+
+static size_t ooc_chunk_bytes(Toolpath *d){
+	return (size_t)d->vertex_count*toolpath_vertex_size(d) + sizeof(PathRun)*d->run_cap + sizeof(int)*2*(d->run_count + 1)
+			+ sizeof(float)*(d->layer_count + 1) + sizeof(PathChunk)*d->chunk_count;
+}
+
+//read a chunk back from the page file and put it on the gpu like a path of its own
+static void ooc_load(Toolpath *tp, OocChunk *c){
+	OocPath *o = tp->ooc;
+	Toolpath *d = (Toolpath *)calloc(1, sizeof(Toolpath));
+	if(d == NULL){
+		perror("Could not allocate space for a chunk!");
+		exit(-1);
+	}
+	*d = (Toolpath){ .file = tp->file, .color = tp->color, .visible = true, .compact = o->compact,
+		.len = c->count + 1, .segment_base = c->first - 1, .segment_total = o->segments, .time_base = c->time };
+	d->path = (Segment *)malloc(sizeof(Segment)*(d->len + 1));
+	if(d->path == NULL){
+		perror("Could not allocate space for a chunk!");
+		exit(-1);
+	}
+	if(fseeko(o->pages, (off_t)(c->first - 1)*(off_t)sizeof(Segment), SEEK_SET) != 0 || fread(d->path, sizeof(Segment), d->len, o->pages) != (size_t)d->len){
+		perror("Could not read from the page file!");
+		exit(-1);
+	}
+
+	toolpath_tessellate(d);
+	toolpath_upload(d);
+	free(d->path);	//the gpu has it now, nothing looks at the segments of a chunk
+	d->path = NULL;
+	if(tp->filter.types) toolpath_filter(d, &tp->filter);
+
+	c->detail = d;
+	c->bytes = ooc_chunk_bytes(d);
+	o->used += c->bytes;
+	o->loaded++;
+}
+
+static void ooc_unload(OocPath *o, OocChunk *c){
+	toolpath_free(c->detail);
+	free(c->detail);
+	c->detail = NULL;
+	o->used -= c->bytes;
+	o->loaded--;
+}
+
+//drop the chunk drawn longest ago that is not in view, false if every loaded chunk is in view
+static bool ooc_evict(OocPath *o){
+	OocChunk *oldest = NULL;
+	for(int i=0; i<o->chunk_count; i++){
+		OocChunk *c = &o->chunks[i];
+		if(c->detail && !c->in_view && (oldest == NULL || c->last_used < oldest->last_used)) oldest = c;
+	}
+	if(oldest == NULL) return false;
+	ooc_unload(o, oldest);
+	return true;
+}
+
+//a box is out of view when all its corners are outside the same side of the clip volume
+static bool ooc_in_view(Matrix m, BoundingBox b, float *depth){
+	int outside[6] = {0};
+	for(int i=0; i<8; i++){
+		float x = i & 1 ? b.max.x : b.min.x, y = i & 2 ? b.max.y : b.min.y, z = i & 4 ? b.max.z : b.min.z;
+		float cx = m.m0*x + m.m4*y + m.m8*z + m.m12;
+		float cy = m.m1*x + m.m5*y + m.m9*z + m.m13;
+		float cz = m.m2*x + m.m6*y + m.m10*z + m.m14;
+		float cw = m.m3*x + m.m7*y + m.m11*z + m.m15;
+		outside[0] += cx < -cw;
+		outside[1] += cx > cw;
+		outside[2] += cy < -cw;
+		outside[3] += cy > cw;
+		outside[4] += cz < -cw;
+		outside[5] += cz > cw;
+		if(i == 0 || cz < *depth) *depth = cz;
+	}
+	for(int i=0; i<6; i++) if(outside[i] == 8) return false;
+	return true;
+}
+
+//load the closest chunks in view that are still on disk, as many as this frame has time for
+static void ooc_page_in(Toolpath *tp){
+	OocPath *o = tp->ooc;
+	double start = profiler_now();
+	for(int loads=0; loads<OOC_LOADS_PER_FRAME; loads++){
+		if(loads > 0 && profiler_now() - start > OOC_FRAME_TIME) break;
+
+		OocChunk *next = NULL;
+		for(int i=0; i<o->chunk_count; i++){
+			OocChunk *c = &o->chunks[i];
+			if(c->in_view && !c->detail && (next == NULL || c->depth < next->depth)) next = c;
+		}
+		if(next == NULL) break;
+
+		while(o->used >= o->budget && ooc_evict(o));
+		if(o->used >= o->budget) break;	//everything loaded is in view, the outline has to do for the rest
+		PROFILE("page in") ooc_load(tp, next);
+		next->last_used = o->frame;
+	}
+}
+
+//draw the loaded chunks in view in detail and the outline of the others in view
+void DrawOocToolpath(Toolpath *tp, float tint_amount, PathColoring *coloring){
+	OocPath *o = tp->ooc;
+	if(!tp->visible || tp->vertex_count == 0) return;
+
+	o->frame++;
+	Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+	for(int i=0; i<o->chunk_count; i++){
+		OocChunk *c = &o->chunks[i];
+		c->in_view = ooc_in_view(mvp, c->bounds, &c->depth);
+		if(c->in_view && c->detail) c->last_used = o->frame;
+	}
+	ooc_page_in(tp);
+
+	PathShader *ps = toolpath_begin_draw(tp, tint_amount, coloring);
+	int chunk = -1;
+	for(int i=0; i<o->chunk_count; i++){
+		OocChunk *c = &o->chunks[i];
+		if(c->in_view && !c->detail && c->outline_count > 0)
+			toolpath_draw_vertices(tp, ps, &chunk, (c->outline_first - 1)*2, c->outline_count*2);
+	}
+	toolpath_end_draw();
+
+	for(int i=0; i<o->chunk_count; i++){
+		Toolpath *d = o->chunks[i].detail;
+		if(!o->chunks[i].in_view || !d) continue;
+		PathFilter *f = &tp->filter;
+		if(f->types && (d->filter.z_min != f->z_min || d->filter.z_max != f->z_max || d->filter.types != f->types)) toolpath_filter(d, f);
+		d->color = tp->color;
+		DrawToolpath(d, tint_amount, coloring);
+	}
+}
+
+void ooc_free(OocPath *o){
+	for(int i=0; i<o->chunk_count; i++) if(o->chunks[i].detail) ooc_unload(o, &o->chunks[i]);
+	if(o->pages) fclose(o->pages);
+	free(o->chunks);
+	free(o);
+}
+
+#endif //OUT_OF_CORE_H
@@ -0,0 +1,179 @@
+//built in profiler: scoped timers, per frame draw counters, an on screen overlay and chrome trace export
+//time a block with PROFILE("name"){ ... }, the name has to be a string literal,
+//leaving the block with break or return skips the measurement
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define PROFILER_MAX_STATS 32
+#define PROFILER_MAX_EVENTS (1 << 20)	//about 32MB of trace before recording stops
+
+#define PROFILE(name) for(double _prof_start = profiler_now(), _prof_once = 1; _prof_once; _prof_once = 0, profile_end(name, _prof_start))
+
+typedef struct ProfileStat{
+	const char *name;
+	double last;	//ms
+	double total;
+	double max;
+	int count;
+}ProfileStat;
+
+typedef struct ProfileCounters{
+	int vertices;	//submitted this frame
+	int draw_calls;
+	int batch_flushes;	//immediate mode batches sent early, by us or because they filled up
+}ProfileCounters;
+
+typedef struct ProfileEvent{
+	const char *name;
+	double start;	//us since the profiler started
+	double duration;	//us, counters store them in args instead
+	uint64_t thread;
+	ProfileCounters args;
+	bool counter;
+}ProfileEvent;
+
+typedef struct Profiler{
+	pthread_mutex_t lock;
+	double epoch;
+	ProfileStat stats[PROFILER_MAX_STATS];
+	int stat_count;
+	ProfileCounters frame;	//being counted
+	ProfileCounters last_frame;
+	ProfileEvent *events;	//only kept when a trace is going to be written
+	int event_count;
+}Profiler;
+
+Profiler profiler = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+//monotonic time in microseconds
+double profiler_now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e6 + ts.tv_nsec/1e3 - profiler.epoch;
+}
+
+//start the clock, with record set every timer and frame is also kept for profiler_write_trace
+void profiler_init(bool record){
+	profiler.epoch = profiler_now();
+	if(record){
+		profiler.events = (ProfileEvent *)malloc(sizeof(ProfileEvent)*PROFILER_MAX_EVENTS);
+		if(profiler.events == NULL) printf("Not enough memory to record a trace\n");
+	}
+}
+
+static void profile_record(ProfileEvent e){
+	if(profiler.events == NULL) return;
+	if(profiler.event_count == PROFILER_MAX_EVENTS){
+		printf("Trace buffer full, recording stopped\n");
+		profiler.event_count++;	//only say it once
+	}
+	if(profiler.event_count < PROFILER_MAX_EVENTS) profiler.events[profiler.event_count++] = e;
+}
+
+void profile_end(const char *name, double start){
+	double end = profiler_now();
+
+	pthread_mutex_lock(&profiler.lock);
+
+	//names are literals, so the pointer is enough to find the stat
+	ProfileStat *stat = NULL;
+	for(int i=0; i<profiler.stat_count; i++){
+		if(profiler.stats[i].name == name) stat = &profiler.stats[i];
+	}
+	if(stat == NULL && profiler.stat_count < PROFILER_MAX_STATS){
+		stat = &profiler.stats[profiler.stat_count++];
+		*stat = (ProfileStat){ .name = name };
+	}
+	if(stat){
+		double ms = (end - start)/1000.0;
+		stat->last = ms;
+		stat->total += ms;
+		if(ms > stat->max) stat->max = ms;
+		stat->count++;
+	}
+
+	profile_record((ProfileEvent){ .name = name, .start = start, .duration = end - start, .thread = (uint64_t)pthread_self() });
+
+	pthread_mutex_unlock(&profiler.lock);
+}
+
+//counters are only touched from the main thread
+void profile_count_draw(int vertices){
+	profiler.frame.draw_calls++;
+	profiler.frame.vertices += vertices;
+}
+
+void profile_count_vertices(int vertices){
+	profiler.frame.vertices += vertices;
+}
+
+void profile_count_flush(bool flushed){
+	if(flushed) profiler.frame.batch_flushes++;
+}
+
+//close the counters of this frame, call once per frame
+void profiler_frame(void){
+	pthread_mutex_lock(&profiler.lock);
+	profile_record((ProfileEvent){ .name = "frame", .start = profiler_now(), .args = profiler.frame, .counter = true });
+	pthread_mutex_unlock(&profiler.lock);
+
+	profiler.last_frame = profiler.frame;
+	profiler.frame = (ProfileCounters){0};
+}
+
+void DrawProfiler(bool dark_mode){
+	Color fg = dark_mode ? LIGHTGRAY : DARKGRAY;
+	int x = 10, y = GetScreenHeight()/2 - 60;
+
+	DrawText(TextFormat("%d fps  %.2f ms", GetFPS(), GetFrameTime()*1000.0f), x, y, 10, fg);
+	y += 14;
+	DrawText(TextFormat("%d vertices  %d draws  %d flushes", profiler.last_frame.vertices, profiler.last_frame.draw_calls, profiler.last_frame.batch_flushes), x, y, 10, fg);
+	y += 18;
+
+	pthread_mutex_lock(&profiler.lock);
+	DrawText("timer          last      avg      max (ms)", x, y, 10, fg);
+	y += 14;
+	for(int i=0; i<profiler.stat_count; i++, y += 12){
+		ProfileStat *s = &profiler.stats[i];
+		DrawText(TextFormat("%-12s %8.3f %8.3f %8.3f", s->name, s->last, s->total/s->count, s->max), x, y, 10, fg);
+	}
+	pthread_mutex_unlock(&profiler.lock);
+}
+
+//write everything recorded as a chrome trace (load it in chrome://tracing or ui.perfetto.dev)
+bool profiler_write_trace(const char *file){
+	FILE *f = fopen(file, "w");
+	if(f == NULL){
+		printf("Could not write trace \"%s\"\n", file);
+		return false;
+	}
+
+	int count = profiler.event_count < PROFILER_MAX_EVENTS ? profiler.event_count : PROFILER_MAX_EVENTS;
+	fprintf(f, "{\"traceEvents\":[\n");
+	for(int i=0; i<count; i++){
+		ProfileEvent *e = &profiler.events[i];
+		if(e->counter){
+			fprintf(f, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"vertices\":%d,\"draw_calls\":%d,\"batch_flushes\":%d}}",
+					e->name, e->start, e->args.vertices, e->args.draw_calls, e->args.batch_flushes);
+		}
+		else{
+			fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu}",
+					e->name, e->start, e->duration, (unsigned long long)e->thread);
+		}
+		fprintf(f, i + 1 < count ? ",\n" : "\n");
+	}
+	fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(f);
+
+	printf("Trace with %d events written to %s\n", count, file);
+	return true;
+}
+
+#endif //PROFILER_H
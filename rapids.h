@@ -0,0 +1,833 @@
+//how much of a program is spent moving through the air: rapids, and feed moves above the plane the program rapids across
+//the cutting between two rapids is an island, the islands are put in a shorter order with nearest neighbour then 2-opt and or-opt,
+//islands whose footprints come close keep the order they had so nothing gets cut before what was meant to come first,
+//and anything between two islands besides plain rapids (a tool change, the spindle, coolant) splits them into groups that stay in place,
+//an island that changes such a state itself is a group of its own so the islands after it still run the way they did
+#ifndef RAPIDS_H
+#define RAPIDS_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "gcode.h"
+#include "line_index.h"
+#include "gcode_stream.h"
+#include "profiler.h"
+
+#define RAPID_KEEP_ORDER 1.0f	//program units, islands whose footprints come closer than this keep their order
+#define RAPID_NEAR 8	//islands tried right after each one, those starting closest to where it ends
+#define RAPID_SLICE 2048	//islands a thread improves at a time, the slices shift every round so their ends move too
+#define RAPID_ROUNDS 6
+#define RAPID_PASSES 20	//over a slice in one round
+#define RAPID_MAX_PAIRS (1 << 24)	//islands that have to keep their order, a group with more stays as it is
+#define RAPID_MAX_THREADS 64
+#define RAPID_GRID_MAX 1024	//cells per side of the grid the nearest island is looked up in
+
+//what the lines between two islands, or of an island, do
+enum{
+	RAPID_LINE_OTHER = 1,	//something besides rapids, feeds and comments
+	RAPID_LINE_INCREMENTAL = 2,	//G91
+	RAPID_LINE_ROTARY = 4,	//A, B or C
+	RAPID_LINE_MODAL = 8,	//something besides moves, feeds and comments, a state the moves after it run with (S, M, T, G54...)
+};
+
+typedef struct RapidIsland{
+	int first, last;	//segments of the first and last cutting move
+	Vector3 entry, exit;	//where the cutting starts and ends, drawing units
+	Vector2 min, max;	//footprint grown by RAPID_KEEP_ORDER
+}RapidIsland;
+
+typedef struct RapidReport{
+	float rate;	//rapid rate, program units per minute
+	int rapids;
+	double rapid_distance, rapid_time;	//program units and seconds
+	int cuts;
+	double cut_distance, cut_time;
+	int air_cuts;	//feed moves at or above the clearance
+	double air_distance, air_time;
+	float clearance;	//lowest z the program rapids across at, drawing units, INFINITY without such rapids
+	int unfed;	//feed moves without a feed rate, left out of the times
+
+	RapidIsland *islands;	//in program order
+	int island_count;
+	int *group_start;	//group_count + 1 offsets into islands and order
+	int group_count;
+	int *order;	//islands in the shorter order, each group in its own place
+	int kept_groups;	//left in program order, too many of their islands overlap
+	int pinned;	//islands left in place because their own lines change the spindle, coolant, offsets or the like
+	bool ordered;	//false without the source text, the groups are not known then
+	int lines;	//RAPID_LINE_INCREMENTAL and RAPID_LINE_ROTARY when the program uses them anywhere
+	float *group_z;	//highest rapid between the islands of each group, drawing units, moved islands are reached at it
+	double before, after;	//travel between the islands of every group in the xy plane, program units
+	double seconds;
+}RapidReport;
+
+typedef struct RapidSlice{
+	int group, first, last;	//positions [first, last) in order
+}RapidSlice;
+
+//what 2-opt needs to know about a group, islands are counted from the first one of the group
+typedef struct RapidGroup{
+	int *partner_start;	//island count + 1 offsets
+	int *partners;	//islands that come close to each one, the two have to keep their order
+	int *near;	//RAPID_NEAR per island, -1 when the group has fewer
+}RapidGroup;
+
+typedef struct RapidJob{
+	RapidReport *r;
+	int thread, threads;
+	unsigned char *kept;	//per group
+	RapidGroup *groups;
+	RapidSlice *slices;
+	int slice_count;
+	int *pos;	//where the islands of the slice being improved are in order, one per thread
+}RapidJob;
+
+typedef struct RapidKey{
+	float x;
+	int island;
+}RapidKey;
+
+//the segment after an arc only marks where the arc ended, it is not a move of its own
+static bool rapid_is_move(Segment *path, int i){
+	return !path[i-1].arc;
+}
+
+static float rapid_xy(Vector3 a, Vector3 b){
+	return sqrtf((a.x - b.x)*(a.x - b.x) + (a.y - b.y)*(a.y - b.y));
+}
+
+static void rapid_grow_footprint(RapidIsland *is, Vector3 p, float margin){
+	is->min.x = fminf(is->min.x, p.x - margin);
+	is->min.y = fminf(is->min.y, p.y - margin);
+	is->max.x = fmaxf(is->max.x, p.x + margin);
+	is->max.y = fmaxf(is->max.y, p.y + margin);
+}
+
+//distances and times of every kind of move, and the islands of cutting between the rapids
+static void rapid_measure(RapidReport *r, Segment *path, int len){
+	r->clearance = INFINITY;
+	for(int i=1; i<len; i++){
+		if(!rapid_is_move(path, i) || path[i].type != 0) continue;
+		Vector3 a = path[i-1].point, b = path[i].point;
+		if(fabsf(a.z - b.z) < 1e-6f && (a.x != b.x || a.y != b.y)) r->clearance = fminf(r->clearance, b.z);
+	}
+
+	float margin = RAPID_KEEP_ORDER*scale;
+	int cap = 0;
+	bool open = false;	//the last move cut, the next one joins its island
+	for(int i=1; i<len; i++){
+		if(!rapid_is_move(path, i)) continue;
+		Segment *s = &path[i];
+		Vector3 from = path[i-1].point;
+		float length = move_length(path, i)/scale;
+
+		if(s->type == 0){
+			r->rapids++;
+			r->rapid_distance += length;
+			open = false;
+			continue;
+		}
+
+		double time = s->feed > 0 ? length/s->feed*60 : 0;
+		if(s->feed <= 0) r->unfed++;
+		r->cuts++;
+		r->cut_distance += length;
+		r->cut_time += time;
+		if(fminf(from.z, s->point.z) >= r->clearance - 1e-6f){
+			r->air_cuts++;
+			r->air_distance += length;
+			r->air_time += time;
+		}
+
+		if(!open){
+			if(r->island_count == cap){
+				cap = cap ? cap*2 : 256;
+				r->islands = (RapidIsland *)realloc(r->islands, sizeof(RapidIsland)*cap);
+				if(r->islands == NULL){
+					perror("Could not allocate space for the islands!");
+					exit(-1);
+				}
+			}
+			r->islands[r->island_count++] = (RapidIsland){
+				.first = i, .entry = from,
+				.min = { INFINITY, INFINITY }, .max = { -INFINITY, -INFINITY }
+			};
+			open = true;
+		}
+		RapidIsland *is = &r->islands[r->island_count - 1];
+		is->last = i;
+		is->exit = s->point;
+		rapid_grow_footprint(is, from, margin);
+		rapid_grow_footprint(is, s->point, margin);
+		if(s->arc) rapid_grow_footprint(is, s->center, margin + s->radius);	//the whole circle, the sweep does not matter here
+	}
+	r->rapid_time = r->rapid_distance/r->rate*60;
+}
+
+//where the line holding segment seg starts and where the one after it starts
+static uint64_t rapid_line_start(LineIndex *lines, int seg){
+	uint64_t offset = 0;
+	line_index_get(lines, seg, NULL, &offset);
+	return offset;
+}
+
+static uint64_t rapid_line_end(LineIndex *lines, int seg, const char *text, size_t len){
+	uint64_t offset = rapid_line_start(lines, seg);
+	const char *nl = (const char *)memchr(text + offset, '\n', len - offset);
+	return nl ? (uint64_t)(nl - text) + 1 : len;
+}
+
+//what the lines of text [from, to) do, see RAPID_LINE_*
+static int rapid_text_flags(const char *text, uint64_t from, uint64_t to){
+	int flags = 0;
+	const char *p = text + from, *end = text + to;
+	while(p < end){
+		char c = *p++;
+		if(c == '('){
+			while(p < end && *p != ')' && *p != '\n') p++;
+			continue;
+		}
+		if(c == ';'){
+			while(p < end && *p != '\n') p++;
+			continue;
+		}
+		if(c < 'A' || c > 'Z' || p == end) continue;
+		if(!((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.')) continue;	//a letter of a word, not an address
+
+		//by hand, strtod would take G0X1 for a hex number
+		double v = 0, unit = 1;
+		if(*p == '-' || *p == '+') p++;
+		while(p < end && *p >= '0' && *p <= '9') v = v*10 + (*p++ - '0');
+		if(p < end && *p == '.') for(p++; p < end && *p >= '0' && *p <= '9'; p++) v += (unit /= 10)*(*p - '0');
+
+		switch(c){
+		case 'G':
+			if(v == 91) flags |= RAPID_LINE_INCREMENTAL | RAPID_LINE_OTHER | RAPID_LINE_MODAL;
+			else if(v == 1 || v == 2 || v == 3) flags |= RAPID_LINE_OTHER;
+			else if(v != 0 && v != 90) flags |= RAPID_LINE_OTHER | RAPID_LINE_MODAL;
+			break;
+		case 'X':
+		case 'Y':
+		case 'Z':
+		case 'F':
+		case 'N':
+			break;
+		case 'I':
+		case 'J':
+		case 'K':
+		case 'R':
+			flags |= RAPID_LINE_OTHER;
+			break;
+		case 'A':
+		case 'B':
+		case 'C':
+			flags |= RAPID_LINE_ROTARY | RAPID_LINE_OTHER | RAPID_LINE_MODAL;
+			break;
+		default:
+			flags |= RAPID_LINE_OTHER | RAPID_LINE_MODAL;
+			break;
+		}
+	}
+	return flags;
+}
+
+//a new group starts wherever the lines between two islands do more than travel,
+//and before and after an island whose own lines change a state, it then stays where it is
+static void rapid_group(RapidReport *r, Segment *path, LineIndex *lines, const char *text, size_t len){
+	r->lines = rapid_text_flags(text, 0, len) & (RAPID_LINE_INCREMENTAL | RAPID_LINE_ROTARY);
+	r->group_start = (int *)malloc(sizeof(int)*(r->island_count + 1));
+	r->group_z = (float *)malloc(sizeof(float)*r->island_count);
+	if(r->group_start == NULL || r->group_z == NULL){
+		perror("Could not allocate space for the groups!");
+		exit(-1);
+	}
+	r->group_count = 0;
+	bool modal = false;	//the island before changed a state
+	for(int i=0; i<r->island_count; i++){
+		bool was_modal = modal;
+		uint64_t from = rapid_line_start(lines, r->islands[i].first);
+		uint64_t to = rapid_line_end(lines, r->islands[i].last, text, len);
+		modal = rapid_text_flags(text, from, to) & RAPID_LINE_MODAL;
+		r->pinned += modal;
+		if(i > 0 && !modal && !was_modal){
+			from = rapid_line_end(lines, r->islands[i-1].last, text, len);
+			to = rapid_line_start(lines, r->islands[i].first);
+			if(from >= to || !(rapid_text_flags(text, from, to) & RAPID_LINE_OTHER)) continue;
+		}
+		r->group_start[r->group_count++] = i;
+	}
+	r->group_start[r->group_count] = r->island_count;
+
+	for(int g=0; g<r->group_count; g++){
+		RapidIsland *first = &r->islands[r->group_start[g]], *last = &r->islands[r->group_start[g + 1] - 1];
+		r->group_z[g] = fmaxf(first->exit.z, last->entry.z);
+		for(int i=first->last + 1; i<last->first; i++) if(path[i].type == 0) r->group_z[g] = fmaxf(r->group_z[g], path[i].point.z);
+	}
+}
+
+static int rapid_compare_keys(const void *a, const void *b){
+	float x = ((const RapidKey *)a)->x, y = ((const RapidKey *)b)->x;
+	return (x > y) - (x < y);
+}
+
+//islands that keep their order, each pair once as (earlier, later), -1 when there are too many
+static long rapid_find_pairs(RapidIsland *is, int n, int **pairs){
+	RapidKey *keys = (RapidKey *)malloc(sizeof(RapidKey)*n);
+	if(keys == NULL){
+		perror("Could not allocate space for the islands!");
+		exit(-1);
+	}
+	for(int i=0; i<n; i++) keys[i] = (RapidKey){ is[i].min.x, i };
+	qsort(keys, n, sizeof(RapidKey), rapid_compare_keys);
+
+	long count = 0, cap = 0;
+	*pairs = NULL;
+	for(int a=0; a<n && count >= 0; a++){
+		RapidIsland *p = &is[keys[a].island];
+		for(int b=a+1; b<n && keys[b].x <= p->max.x; b++){
+			RapidIsland *q = &is[keys[b].island];
+			if(q->min.y > p->max.y || q->max.y < p->min.y) continue;
+			if(count == RAPID_MAX_PAIRS){
+				count = -1;
+				break;
+			}
+			if(count == cap){
+				cap = cap ? cap*2 : 1024;
+				*pairs = (int *)realloc(*pairs, sizeof(int)*2*cap);
+				if(*pairs == NULL){
+					perror("Could not allocate space for the islands!");
+					exit(-1);
+				}
+			}
+			int i = keys[a].island, j = keys[b].island;
+			(*pairs)[count*2] = i < j ? i : j;
+			(*pairs)[count*2 + 1] = i < j ? j : i;
+			count++;
+		}
+	}
+	free(keys);
+	return count;
+}
+
+//islands filed by the grid cell of their entry
+typedef struct RapidGrid{
+	int side;
+	Vector2 lo;
+	float cw, ch;
+	int *head;	//per cell
+	int *next, *prev, *cell;	//per island
+}RapidGrid;
+
+static int rapid_grid_cell(RapidGrid *g, Vector3 p){
+	int cx = (int)((p.x - g->lo.x)/g->cw), cy = (int)((p.y - g->lo.y)/g->ch);
+	cx = cx < 0 ? 0 : cx >= g->side ? g->side - 1 : cx;
+	cy = cy < 0 ? 0 : cy >= g->side ? g->side - 1 : cy;
+	return cy*g->side + cx;
+}
+
+static void rapid_grid_add(RapidGrid *g, RapidIsland *is, int i){
+	int c = rapid_grid_cell(g, is[i].entry);
+	g->cell[i] = c;
+	g->prev[i] = -1;
+	g->next[i] = g->head[c];
+	if(g->head[c] >= 0) g->prev[g->head[c]] = i;
+	g->head[c] = i;
+}
+
+static void rapid_grid_remove(RapidGrid *g, int i){
+	if(g->prev[i] >= 0) g->next[g->prev[i]] = g->next[i];
+	else g->head[g->cell[i]] = g->next[i];
+	if(g->next[i] >= 0) g->prev[g->next[i]] = g->prev[i];
+}
+
+//the k islands in the grid starting closest to at, besides skip, nearest first,
+//ring after ring of cells around at until no cell further out can hold anything closer
+static int rapid_grid_nearest(RapidGrid *g, RapidIsland *is, Vector3 at, int skip, int *out, int k){
+	int c = rapid_grid_cell(g, at), cx = c % g->side, cy = c / g->side;
+	float dist[RAPID_NEAR];
+	int found = 0;
+	for(int ring=0; ring<g->side; ring++){
+		for(int y=cy-ring; y<=cy+ring; y++){
+			if(y < 0 || y >= g->side) continue;
+			int step = y == cy - ring || y == cy + ring ? 1 : 2*ring;
+			for(int x=cx-ring; x<=cx+ring; x+=step){
+				if(x < 0 || x >= g->side) continue;
+				for(int i=g->head[y*g->side + x]; i>=0; i=g->next[i]){
+					if(i == skip) continue;
+					float d = rapid_xy(at, is[i].entry);
+					int n = found < k ? found++ : k;
+					while(n > 0 && (dist[n-1] > d || (dist[n-1] == d && out[n-1] > i))){	//ties by index, the same whatever order the cells hold them in
+						if(n < k){
+							dist[n] = dist[n-1];
+							out[n] = out[n-1];
+						}
+						n--;
+					}
+					if(n < k){
+						dist[n] = d;
+						out[n] = i;
+					}
+				}
+			}
+		}
+		if(found == k && dist[k-1] <= ring*fminf(g->cw, g->ch)) break;
+	}
+	return found;
+}
+
+//nearest neighbour from where the group starts, an island only becomes a candidate once every island it has to follow is done,
+//the islands each one has to keep its order with and the ones starting closest to where it ends are kept for 2-opt
+static bool rapid_order_group(RapidReport *r, int group, RapidGroup *d){
+	int first = r->group_start[group], n = r->group_start[group + 1] - first;
+	RapidIsland *is = r->islands + first;
+	int *order = r->order + first;
+	for(int i=0; i<n; i++) order[i] = first + i;
+	if(n < 3) return true;
+
+	int *pairs;
+	long pair_count = rapid_find_pairs(is, n, &pairs);
+	if(pair_count < 0){
+		free(pairs);
+		return false;
+	}
+
+	int *pending = (int *)calloc(n, sizeof(int));	//earlier islands it has to wait for
+	d->partner_start = (int *)calloc(n + 1, sizeof(int));
+	d->partners = (int *)malloc(sizeof(int)*(pair_count*2 + 1));
+	d->near = (int *)malloc(sizeof(int)*n*RAPID_NEAR);
+	RapidGrid g = { .side = (int)ceilf(sqrtf(n/2.0f)) };
+	if(g.side > RAPID_GRID_MAX) g.side = RAPID_GRID_MAX;
+	g.head = (int *)malloc(sizeof(int)*g.side*g.side);
+	g.next = (int *)malloc(sizeof(int)*n*3);
+	if(pending == NULL || d->partner_start == NULL || d->partners == NULL || d->near == NULL || g.head == NULL || g.next == NULL){
+		perror("Could not allocate space for ordering the islands!");
+		exit(-1);
+	}
+	g.prev = g.next + n;
+	g.cell = g.prev + n;
+
+	for(long p=0; p<pair_count; p++){
+		d->partner_start[pairs[p*2] + 1]++;
+		d->partner_start[pairs[p*2 + 1] + 1]++;
+		pending[pairs[p*2 + 1]]++;
+	}
+	for(int i=0; i<n; i++) d->partner_start[i + 1] += d->partner_start[i];
+	for(long p=0; p<pair_count; p++){
+		d->partners[d->partner_start[pairs[p*2]]++] = pairs[p*2 + 1];
+		d->partners[d->partner_start[pairs[p*2 + 1]]++] = pairs[p*2];
+	}
+	for(int i=n; i>0; i--) d->partner_start[i] = d->partner_start[i - 1];
+	d->partner_start[0] = 0;
+	free(pairs);
+
+	Vector2 hi = { -INFINITY, -INFINITY };
+	g.lo = (Vector2){ INFINITY, INFINITY };
+	for(int i=0; i<n; i++){
+		g.lo.x = fminf(g.lo.x, is[i].entry.x);
+		g.lo.y = fminf(g.lo.y, is[i].entry.y);
+		hi.x = fmaxf(hi.x, is[i].entry.x);
+		hi.y = fmaxf(hi.y, is[i].entry.y);
+	}
+	g.cw = fmaxf((hi.x - g.lo.x)/g.side, 1e-6f);
+	g.ch = fmaxf((hi.y - g.lo.y)/g.side, 1e-6f);
+
+	for(int c=0; c<g.side*g.side; c++) g.head[c] = -1;
+	for(int i=0; i<n; i++) rapid_grid_add(&g, is, i);
+	for(int i=0; i<n; i++){
+		int *near = d->near + i*RAPID_NEAR;
+		for(int k=rapid_grid_nearest(&g, is, is[i].exit, i, near, RAPID_NEAR); k<RAPID_NEAR; k++) near[k] = -1;
+	}
+
+	for(int c=0; c<g.side*g.side; c++) g.head[c] = -1;
+	for(int i=0; i<n; i++) if(pending[i] == 0) rapid_grid_add(&g, is, i);
+	Vector3 at = is[0].entry;	//the lines before the group leave the tool there
+	for(int k=0; k<n; k++){
+		int i;
+		rapid_grid_nearest(&g, is, at, -1, &i, 1);
+		rapid_grid_remove(&g, i);
+		order[k] = first + i;
+		at = is[i].exit;
+		for(int p=d->partner_start[i]; p<d->partner_start[i + 1]; p++){
+			int later = d->partners[p];
+			if(later > i && --pending[later] == 0) rapid_grid_add(&g, is, later);
+		}
+	}
+
+	free(pending);
+	free(g.head);
+	free(g.next);
+	return true;
+}
+
+static void *rapid_order_groups(void *arg){
+	RapidJob *j = (RapidJob *)arg;
+	for(int g=j->thread; g<j->r->group_count; g += j->threads) j->kept[g] = !rapid_order_group(j->r, g, &j->groups[g]);
+	return NULL;
+}
+
+//travel from island to island in t[first, last), fw going along the order and bw going back it, from position s on
+static void rapid_prefix(RapidIsland *is, int *t, int first, int last, double *fw, double *bw, int s){
+	if(s == 0) fw[0] = bw[0] = 0;
+	for(int k=s; first + k + 1 < last; k++){
+		fw[k + 1] = fw[k] + rapid_xy(is[t[first + k]].exit, is[t[first + k + 1]].entry);
+		bw[k + 1] = bw[k] + rapid_xy(is[t[first + k + 1]].exit, is[t[first + k]].entry);
+	}
+}
+
+//an island of t[x..y] has to keep its order with one of t[from..to], pos holds where the islands of the slice are
+static bool rapid_clash(RapidGroup *d, int gs, int *t, int *pos, int x, int y, int from, int to){
+	for(int k=x; k<=y; k++){
+		int u = t[k] - gs;
+		for(int p=d->partner_start[u]; p<d->partner_start[u + 1]; p++){
+			int v = gs + d->partners[p], at = pos[v];
+			if(at >= from && at <= to && t[at] == v) return true;	//pos is stale for islands of other slices
+		}
+	}
+	return false;
+}
+
+//one slice being improved
+typedef struct RapidSliceWork{
+	RapidIsland *is;
+	RapidGroup *d;
+	int *t, *pos;
+	double *fw, *bw;	//see rapid_prefix
+	int a, b;	//the slice
+	int gs, ge;	//its group
+	int lo, hi;	//positions that may move
+}RapidSliceWork;
+
+//travel from the island at position from to the one at to, from the start of the group before it and nothing past its end
+static double rapid_hop(RapidSliceWork *w, int from, int to){
+	if(to >= w->ge) return 0;
+	return rapid_xy(from < w->gs ? w->is[w->gs].entry : w->is[w->t[from]].exit, w->is[w->t[to]].entry);
+}
+
+//turn t[x..y] around if that shortens the travel and none of its islands have to keep their order among themselves
+static bool rapid_try_reverse(RapidSliceWork *w, int x, int y){
+	if(x < w->lo || y > w->hi || x >= y) return false;
+	int *t = w->t;
+	double old = rapid_hop(w, x - 1, x) + w->fw[y - w->a] - w->fw[x - w->a] + rapid_hop(w, y, y + 1);
+	double new = rapid_hop(w, x - 1, y) + w->bw[y - w->a] - w->bw[x - w->a];
+	if(y + 1 < w->ge) new += rapid_xy(w->is[t[x]].exit, w->is[t[y + 1]].entry);
+	if(old - new <= 1e-6 || rapid_clash(w->d, w->gs, t, w->pos, x, y, x, y)) return false;
+
+	for(; x<y; x++, y--){
+		int swap = t[x];
+		t[x] = t[y];
+		t[y] = swap;
+		w->pos[t[x]] = x;
+		w->pos[t[y]] = y;
+	}
+	return true;
+}
+
+//move t[x..y] as it is to right after position k, if that shortens the travel and it does not pass an island it has to keep its order with
+static bool rapid_try_move(RapidSliceWork *w, int x, int y, int k){
+	if(x < w->lo || y > w->hi || (k >= x - 1 && k <= y)) return false;
+	int first = k > y ? x : k + 1, last = k > y ? k : y;	//positions that change
+	if(first < w->lo || last > w->hi) return false;
+
+	double old = rapid_hop(w, x - 1, x) + rapid_hop(w, y, y + 1) + rapid_hop(w, k, k + 1);
+	double new = rapid_hop(w, x - 1, y + 1) + rapid_hop(w, k, x) + rapid_hop(w, y, k + 1);
+	if(old - new <= 1e-6) return false;
+	if(k > y ? rapid_clash(w->d, w->gs, w->t, w->pos, x, y, y + 1, k) : rapid_clash(w->d, w->gs, w->t, w->pos, x, y, k + 1, x - 1)) return false;
+
+	int chain[3], length = y - x + 1;
+	memcpy(chain, w->t + x, sizeof(int)*length);
+	if(k > y) memmove(w->t + x, w->t + y + 1, sizeof(int)*(k - y));
+	else memmove(w->t + k + 1 + length, w->t + k + 1, sizeof(int)*(x - k - 1));
+	memcpy(w->t + (k > y ? k - length + 1 : k + 1), chain, sizeof(int)*length);
+	for(int p=first; p<=last; p++) w->pos[w->t[p]] = p;
+	return true;
+}
+
+//2-opt and or-opt inside a slice, trying the moves that put an island right before or after one of the islands
+//starting closest to where it ends, or move a chain of up to three islands next to one of them,
+//the first island of the slice stays put unless the group starts there and the last one unless the group ends there,
+//so the slices next to it can be worked on at the same time
+static void rapid_improve_slice(RapidReport *r, RapidGroup *d, RapidSlice *s, int *pos){
+	RapidSliceWork w = {
+		.is = r->islands, .d = d, .t = r->order, .pos = pos,
+		.a = s->first, .b = s->last, .gs = r->group_start[s->group], .ge = r->group_start[s->group + 1]
+	};
+	w.lo = w.a == w.gs ? w.a : w.a + 1;
+	w.hi = w.b == w.ge ? w.b - 1 : w.b - 2;
+	if(w.hi - w.lo < 1) return;
+
+	w.fw = (double *)malloc(sizeof(double)*(w.b - w.a)*2);
+	if(w.fw == NULL){
+		perror("Could not allocate space for ordering the islands!");
+		exit(-1);
+	}
+	w.bw = w.fw + (w.b - w.a);
+	rapid_prefix(w.is, w.t, w.a, w.b, w.fw, w.bw, 0);
+	for(int k=w.a; k<w.b; k++) pos[w.t[k]] = k;
+
+	bool improved = true;
+	for(int pass=0; pass<RAPID_PASSES && improved; pass++){
+		improved = false;
+		for(int i=w.a; i<w.b; i++){
+			int *near = d->near + (w.t[i] - w.gs)*RAPID_NEAR;
+			for(int c=0; c<RAPID_NEAR && near[c] >= 0; c++){
+				int island = w.gs + near[c], p = pos[island];
+				if(p < w.a || p >= w.b || w.t[p] != island) continue;	//pos is stale for islands of other slices
+
+				//t[i] then the island: turn around what is between them, or take t[i] and the islands before it over,
+				//or bring the island and the ones after it
+				int changed = -1;
+				if(rapid_try_reverse(&w, p > i ? i + 1 : p + 1, p > i ? p : i)) changed = p > i ? i + 1 : p + 1;
+				else if(rapid_try_reverse(&w, p > i ? i : p, p > i ? p - 1 : i - 1)) changed = p > i ? i : p;
+				for(int length=1; length<=3 && changed < 0; length++){
+					if(rapid_try_move(&w, i - length + 1, i, p - 1)) changed = p > i ? i - length + 1 : p;
+					else if(rapid_try_move(&w, p, p + length - 1, i)) changed = p > i ? i + 1 : p;
+				}
+				if(changed < 0) continue;
+
+				rapid_prefix(w.is, w.t, w.a, w.b, w.fw, w.bw, changed - 1 > w.a ? changed - 1 - w.a : 0);
+				improved = true;
+				near = d->near + (w.t[i] - w.gs)*RAPID_NEAR;	//t[i] may be another island now
+				c = -1;
+			}
+		}
+	}
+	free(w.fw);
+}
+
+static void *rapid_improve_slices(void *arg){
+	RapidJob *j = (RapidJob *)arg;
+	for(int k=j->thread; k<j->slice_count; k += j->threads){
+		RapidSlice *s = &j->slices[k];
+		rapid_improve_slice(j->r, &j->groups[s->group], s, j->pos);
+	}
+	return NULL;
+}
+
+static void rapid_run(RapidJob *jobs, int threads, void *(*pass)(void *)){
+	pthread_t thread[RAPID_MAX_THREADS];
+	for(int i=1; i<threads; i++) pthread_create(&thread[i], NULL, pass, &jobs[i]);
+	pass(&jobs[0]);
+	for(int i=1; i<threads; i++) pthread_join(thread[i], NULL);
+}
+
+//xy travel of every group from where it starts through its islands in order, program units
+static double rapid_travel(RapidReport *r, int *order){
+	double total = 0;
+	for(int g=0; g<r->group_count; g++){
+		Vector3 at = r->islands[r->group_start[g]].entry;
+		for(int k=r->group_start[g]; k<r->group_start[g + 1]; k++){
+			total += rapid_xy(at, r->islands[order[k]].entry);
+			at = r->islands[order[k]].exit;
+		}
+	}
+	return total/scale;
+}
+
+//text is the source of the program, without it only the distances and times are worked out, threads 0 uses every core
+RapidReport rapid_analyze(Segment *path, int len, LineIndex *lines, const char *text, size_t text_len, float rate, int threads){
+	RapidReport r = { .rate = rate };
+	double start = profiler_now();
+	rapid_measure(&r, path, len);
+
+	r.order = (int *)malloc(sizeof(int)*(r.island_count + 1));
+	if(r.order == NULL){
+		perror("Could not allocate space for the islands!");
+		exit(-1);
+	}
+	for(int i=0; i<r.island_count; i++) r.order[i] = i;
+	if(text == NULL || r.island_count == 0){
+		r.seconds = (profiler_now() - start)/1e6;
+		return r;
+	}
+	rapid_group(&r, path, lines, text, text_len);
+	r.ordered = true;
+	r.before = rapid_travel(&r, r.order);
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1) threads = 1;
+	if(threads > RAPID_MAX_THREADS) threads = RAPID_MAX_THREADS;
+	RapidJob *jobs = (RapidJob *)calloc(threads, sizeof(RapidJob));
+	unsigned char *kept = (unsigned char *)calloc(r.group_count, 1);
+	RapidGroup *groups = (RapidGroup *)calloc(r.group_count, sizeof(RapidGroup));
+	RapidSlice *slices = (RapidSlice *)malloc(sizeof(RapidSlice)*(r.island_count/RAPID_SLICE + r.group_count*2));
+	int *pos = (int *)calloc((size_t)r.island_count*threads, sizeof(int));
+	if(jobs == NULL || kept == NULL || groups == NULL || slices == NULL || pos == NULL){
+		perror("Could not allocate space for ordering the islands!");
+		exit(-1);
+	}
+	for(int i=0; i<threads; i++){
+		jobs[i] = (RapidJob){
+			.r = &r, .thread = i, .threads = threads, .kept = kept, .groups = groups,
+			.slices = slices, .pos = pos + (size_t)r.island_count*i
+		};
+	}
+	rapid_run(jobs, threads, rapid_order_groups);
+
+	int idle = 0;	//rounds in a row that gained nothing
+	for(int round=0; round<RAPID_ROUNDS && idle<2; round++){
+		int count = 0;
+		for(int g=0; g<r.group_count; g++){
+			int gs = r.group_start[g], ge = r.group_start[g + 1];
+			if(kept[g] || ge - gs < 3) continue;
+			int at = gs + (round & 1 ? RAPID_SLICE/2 : 0);
+			if(at > gs) slices[count++] = (RapidSlice){ g, gs, at < ge ? at : ge };
+			for(; at < ge; at += RAPID_SLICE) slices[count++] = (RapidSlice){ g, at, at + RAPID_SLICE < ge ? at + RAPID_SLICE : ge };
+		}
+		for(int i=0; i<threads; i++) jobs[i].slice_count = count;
+		double travel = rapid_travel(&r, r.order);
+		rapid_run(jobs, threads, rapid_improve_slices);
+		idle = rapid_travel(&r, r.order) < travel ? 0 : idle + 1;	//the shifted slices may still find something
+	}
+
+	for(int g=0; g<r.group_count; g++){
+		r.kept_groups += kept[g];
+		free(groups[g].partner_start);
+		free(groups[g].partners);
+		free(groups[g].near);
+	}
+	r.after = rapid_travel(&r, r.order);
+	free(jobs);
+	free(kept);
+	free(groups);
+	free(slices);
+	free(pos);
+	r.seconds = (profiler_now() - start)/1e6;
+	return r;
+}
+
+//the whole program after decompressing, NULL for stdin and pipes which can not be read twice
+char *rapid_read_source(const char *file, size_t *len){
+	*len = 0;
+	if(gcode_stream_is_live(file)) return NULL;
+	GcodeStream *g = gcode_stream_open(file);
+	if(g == NULL) return NULL;
+
+	size_t cap = STREAM_BUFFER_SIZE;
+	char *text = (char *)malloc(cap + 1);
+	size_t n;
+	while(text != NULL && (n = gcode_stream_read(g, text + *len, cap - *len)) > 0){
+		*len += n;
+		if(*len == cap) text = (char *)realloc(text, (cap *= 2) + 1);
+	}
+	if(text == NULL){
+		perror("Could not allocate space for the program!");
+		exit(-1);
+	}
+	text[*len] = '\0';
+	gcode_stream_close(g);
+	return text;
+}
+
+//formats like 3m 07.2s into buf
+static char *rapid_time(char *buf, double seconds){
+	if(seconds < 60) sprintf(buf, "%.1fs", seconds);
+	else if(seconds < 3600) sprintf(buf, "%dm %04.1fs", (int)(seconds/60), fmod(seconds, 60));
+	else sprintf(buf, "%dh %02dm %02ds", (int)(seconds/3600), (int)fmod(seconds/60, 60), (int)fmod(seconds, 60));
+	return buf;
+}
+
+void rapid_report_print(const char *file, const RapidReport *r){
+	char a[32], b[32];
+	printf("%s: %d rapids, %d feed moves, %d islands", file, r->rapids, r->cuts, r->island_count);
+	if(r->ordered) printf(" in %d groups", r->group_count);
+	printf(", analysed in %.2fs\n", r->seconds);
+	printf("  rapids    %.1f long, %s at %g/min\n", r->rapid_distance, rapid_time(a, r->rapid_time), r->rate);
+	printf("  cutting   %.1f long, %s\n", r->cut_distance, rapid_time(a, r->cut_time));
+	if(r->clearance < INFINITY)
+		printf("  air cuts  %d feed moves above z %g, where the program rapids across, %.1f long, %s\n",
+				r->air_cuts, r->clearance/scale + 0.0f, r->air_distance, rapid_time(a, r->air_time));
+	printf("  in the air %s of %s\n", rapid_time(a, r->rapid_time + r->air_time), rapid_time(b, r->rapid_time + r->cut_time));
+	if(r->unfed) printf("  %d feed moves have no feed rate and are left out of the times\n", r->unfed);
+
+	if(!r->ordered){
+		if(r->island_count > 0) printf("  the source can not be read again, the islands were not reordered\n");
+		return;
+	}
+	double saved = r->before - r->after;
+	printf("  reordering the islands cuts the travel between them from %.1f to %.1f, %.1f shorter (%.0f%% of all rapids), about %s\n",
+			r->before, r->after, saved, r->rapid_distance > 0 ? saved/r->rapid_distance*100 : 0, rapid_time(a, saved/r->rate*60));
+	if(r->kept_groups) printf("  %d groups have too many overlapping islands and were left in order\n", r->kept_groups);
+	if(r->pinned) printf("  %d islands change the spindle, coolant, offsets or the like and were left in place\n", r->pinned);
+}
+
+//what follows a group expects to come after its last island, when another one ended it go back up and set the feed that island left
+static void rapid_write_group_end(FILE *f, const RapidReport *r, Segment *path, int last, int group){
+	if(r->order[last] == last) return;
+	fprintf(f, "G0 Z%.4f\n", r->group_z[group]/scale);
+	float feed = path[r->islands[last].last].feed;
+	if(feed > 0 && feed != path[r->islands[r->order[last]].last].feed) fprintf(f, "F%g\n", feed);
+}
+
+//the program with the islands of every group in the new order, the lines between groups as they were,
+//a moved island is reached by going up to the highest rapid of its group, across and down to where it starts
+bool rapid_write(const char *out_file, const RapidReport *r, Segment *path, LineIndex *lines, const char *text, size_t len){
+	if(!r->ordered || r->island_count == 0){
+		printf("Nothing to reorder in the program\n");
+		return false;
+	}
+	if(r->lines & RAPID_LINE_INCREMENTAL){
+		printf("The program uses incremental moves (G91), they can not be reordered\n");
+		return false;
+	}
+	if(r->lines & RAPID_LINE_ROTARY){
+		printf("The program turns rotary axes, it can not be reordered\n");
+		return false;
+	}
+
+	FILE *f = fopen(out_file, "w");
+	if(f == NULL){
+		perror("Could not open the reordered program");
+		return false;
+	}
+	RapidIsland *is = r->islands;
+	uint64_t from, to = rapid_line_start(lines, is[0].first);
+	fwrite(text, 1, to, f);
+
+	for(int g=0; g<r->group_count; g++){
+		int gs = r->group_start[g], ge = r->group_start[g + 1];
+		if(g > 0){
+			rapid_write_group_end(f, r, path, gs - 1, g - 1);
+			from = rapid_line_end(lines, is[gs - 1].last, text, len);
+			to = rapid_line_start(lines, is[gs].first);
+			fwrite(text + from, 1, to - from, f);
+		}
+		for(int k=gs; k<ge; k++){
+			int i = r->order[k];
+			if(k > gs && r->order[k - 1] == i - 1){	//the program went this way already
+				from = rapid_line_end(lines, is[i - 1].last, text, len);
+				to = rapid_line_start(lines, is[i].first);
+				fwrite(text + from, 1, to - from, f);
+			}
+			else if(k > gs || i != gs){
+				fprintf(f, "G0 Z%.4f\nG0 X%.4f Y%.4f\nG0 Z%.4f\n", r->group_z[g]/scale, is[i].entry.x/scale, is[i].entry.y/scale, is[i].entry.z/scale);
+				if(path[is[i].first].feed > 0) fprintf(f, "F%g\n", path[is[i].first].feed);
+			}
+			from = rapid_line_start(lines, is[i].first);
+			to = rapid_line_end(lines, is[i].last, text, len);
+			fwrite(text + from, 1, to - from, f);
+		}
+	}
+
+	int last = r->island_count - 1;
+	rapid_write_group_end(f, r, path, last, r->group_count - 1);
+	from = rapid_line_end(lines, is[last].last, text, len);
+	fwrite(text + from, 1, len - from, f);
+	bool ok = !ferror(f);
+	if(fclose(f) != 0) ok = false;
+	if(!ok) perror("Could not write the reordered program");
+	return ok;
+}
+
+void rapid_report_free(RapidReport *r){
+	free(r->islands);
+	free(r->group_start);
+	free(r->group_z);
+	free(r->order);
+	*r = (RapidReport){0};
+}
+
+#endif //RAPIDS_H
@@ -0,0 +1,196 @@
+//offscreen rendering of previews to png, for generating thumbnails without anyone looking at a window
+//all the programs share one hidden gl context, one render target and one set of path buffers,
+//they are parsed a few at a time in parallel and rendered one after the other
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "session.h"	//Light comes from rlights.h, which main.c includes with its implementation
+
+enum{
+	VIEW_ISO = 1 << 0,
+	VIEW_TOP = 1 << 1,
+	VIEW_FRONT = 1 << 2,
+};
+
+static const struct{
+	int flag;
+	const char *name;
+	Vector3 direction;	//from the target towards the camera
+	Vector3 up;
+}render_views[] = {
+	{VIEW_ISO, "iso", {1.0f, -1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+	{VIEW_TOP, "top", {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}},
+	{VIEW_FRONT, "front", {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+};
+#define RENDER_VIEW_COUNT (sizeof(render_views)/sizeof(render_views[0]))
+
+//turn "iso,top" into view flags, 0 if a name is not known
+int parse_render_views(const char *list){
+	int views = 0;
+	char buf[64];
+	strncpy(buf, list, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	for(char *name = strtok(buf, ","); name != NULL; name = strtok(NULL, ",")){
+		int found = 0;
+		for(unsigned v=0; v<RENDER_VIEW_COUNT; v++){
+			if(strcmp(name, render_views[v].name) == 0) found = render_views[v].flag;
+		}
+		if(!found) return 0;
+		views |= found;
+	}
+	return views;
+}
+
+//orthographic camera looking along the view direction that fits the box
+static Camera3D render_camera(BoundingBox box, int view){
+	Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+	Vector3 dir = Vector3Normalize(render_views[view].direction);
+	Vector3 up = render_views[view].up;
+	Vector3 right = Vector3Normalize(Vector3CrossProduct(Vector3Scale(dir, -1.0f), up));
+	up = Vector3CrossProduct(right, Vector3Scale(dir, -1.0f));
+
+	//size of the box seen from this side
+	float w = 0, h = 0, depth = 0;
+	for(int c=0; c<8; c++){
+		Vector3 corner = {c & 1 ? box.max.x : box.min.x, c & 2 ? box.max.y : box.min.y, c & 4 ? box.max.z : box.min.z};
+		Vector3 d = Vector3Subtract(corner, center);
+		w = fmaxf(w, 2*fabsf(Vector3DotProduct(d, right)));
+		h = fmaxf(h, 2*fabsf(Vector3DotProduct(d, up)));
+		depth = fmaxf(depth, Vector3Length(d));
+	}
+
+	Camera3D camera = {0};
+	camera.target = center;
+	camera.position = Vector3Add(center, Vector3Scale(dir, depth + 1.0f));
+	camera.up = up;
+	camera.fovy = fmaxf(fmaxf(w, h)*1.1f, 0.1f);	//the images are square
+	camera.projection = CAMERA_ORTHOGRAPHIC;
+	return camera;
+}
+
+//the model that goes with a program: same file name, or the only model there is
+static ModelFile *render_model_for(Session *s, char *gcode_file){
+	if(s->model_count == 1) return &s->models[0];
+
+	char name[256];
+	strncpy(name, GetFileNameWithoutExt(gcode_file), sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	for(int i=0; i<s->model_count; i++){
+		if(strcmp(name, GetFileNameWithoutExt(s->models[i].file)) == 0) return &s->models[i];
+	}
+	return NULL;
+}
+
+static void *render_parse_thread(void *arg){
+	Toolpath *tp = (Toolpath *)arg;
+	PROFILE("parse") tp->len = parse_gcode(tp->file, &tp->path, &tp->lines);
+	if(tp->len < 0) return NULL;	//skipped, the rest of the batch still gets rendered
+	PROFILE("tessellate") toolpath_tessellate(tp);
+	return NULL;
+}
+
+//render every program in the session from the requested views into out_dir as <name>_<view>.png,
+//needs an initialised (hidden) window, returns the number of images that could not be written,
+//a program that can not be read counts as one and the others are rendered anyway
+int render_session(Session *s, char *out_dir, int size, int views, bool dark_mode, Shader model_shader, Light *light){
+	int failed = 0;
+	RenderTexture2D target = LoadRenderTexture(size, size);
+
+	//the models are shared by all programs, so load them all once up front
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*(s->model_count + 1));
+	for(int i=0; i<s->model_count; i++) pthread_create(&threads[i], NULL, read_model_thread, &s->models[i]);
+	for(int i=0; i<s->model_count; i++) pthread_join(threads[i], NULL);
+	free(threads);
+	Toolpath *paths = s->toolpaths;
+	int path_count = s->toolpath_count;
+	s->toolpath_count = 0;	//keep session_upload away from the programs, they get shared buffers below
+	session_upload(s, model_shader);
+	s->toolpath_count = path_count;
+
+	unsigned int vao = 0, vbo = 0;
+	int cap = 0;
+
+	int batch = sysconf(_SC_NPROCESSORS_ONLN);
+	if(batch < 1) batch = 1;
+	threads = (pthread_t *)malloc(sizeof(pthread_t)*batch);
+
+	for(int first=0; first<path_count; first += batch){
+		int count = path_count - first < batch ? path_count - first : batch;
+		for(int i=0; i<count; i++){
+			paths[first + i].compact = s->compact;
+			pthread_create(&threads[i], NULL, render_parse_thread, &paths[first + i]);
+		}
+		for(int i=0; i<count; i++) pthread_join(threads[i], NULL);
+
+		for(int i=0; i<count; i++){
+			Toolpath *tp = &paths[first + i];
+			if(tp->len < 0){
+				printf("Skipped %s\n", tp->file);
+				failed++;
+				toolpath_free(tp);
+				continue;
+			}
+			ModelFile *m = render_model_for(s, tp->file);
+
+			BoundingBox box = toolpath_bounds(tp);
+			if(m){
+				box.min = Vector3Min(box.min, Vector3Scale(m->bounds.min, scale));
+				box.max = Vector3Max(box.max, Vector3Scale(m->bounds.max, scale));
+			}
+			PROFILE("upload") toolpath_upload_shared(tp, &vao, &vbo, &cap);
+
+			for(unsigned v=0; v<RENDER_VIEW_COUNT; v++){
+				if(!(views & render_views[v].flag)) continue;
+				Camera3D camera = render_camera(box, v);
+
+				light->position = camera.position;
+				UpdateLightValues(model_shader, *light);
+				float cameraPos[3] = { camera.position.x, camera.position.y, camera.position.z };
+				SetShaderValue(model_shader, model_shader.locs[SHADER_LOC_VECTOR_VIEW], cameraPos, SHADER_UNIFORM_VEC3);
+
+				BeginTextureMode(target);
+				ClearBackground(dark_mode ? BLACK : RAYWHITE);
+				BeginMode3D(camera);
+				PROFILE("draw path") DrawToolpath(tp, 0.0f, NULL);
+				if(m) PROFILE("draw model") DrawModelFile(m, GRAY);
+				EndMode3D();
+				EndTextureMode();
+
+				//render textures come back upside down
+				Image image;
+				PROFILE("readback"){
+					image = LoadImageFromTexture(target.texture);
+					ImageFlipVertical(&image);
+				}
+				char out[1024];
+				snprintf(out, sizeof(out), "%s/%s_%s.png", out_dir, GetFileNameWithoutExt(tp->file), render_views[v].name);
+				bool written;
+				PROFILE("png") written = ExportImage(image, out);
+				if(written) printf("Rendered %s\n", out);
+				else{
+					printf("Could not write %s\n", out);
+					failed++;
+				}
+				UnloadImage(image);
+			}
+
+			//the buffers belong to the batch, not to the program
+			tp->vao = tp->vbo = 0;
+			toolpath_free(tp);
+		}
+	}
+
+	free(threads);
+	if(vao) rlUnloadVertexArray(vao);
+	if(vbo) rlUnloadVertexBuffer(vbo);
+	UnloadRenderTexture(target);
+	s->toolpath_count = 0;	//already freed
+	return failed;
+}
+
+#endif //RENDER_H
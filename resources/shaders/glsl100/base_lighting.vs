@@ -9,6 +9,8 @@ attribute vec4 vertexColor;
 // Input uniform values
 uniform mat4 mvp;
 uniform mat4 matModel;
+uniform vec3 meshOrigin;    // compact meshes store positions quantized to 16 bits,
+uniform vec3 meshStep;      // float ones use a zero origin and a step of one
 
 // Output vertex attributes (to fragment shader)
 varying vec3 fragPosition;
@@ -46,8 +48,10 @@ mat3 transpose(mat3 m)
 
 void main()
 {
+    vec3 position = meshOrigin + vertexPosition*meshStep;
+
     // Send vertex attributes to fragment shader
-    fragPosition = vec3(matModel*vec4(vertexPosition, 1.0));
+    fragPosition = vec3(matModel*vec4(position, 1.0));
     fragTexCoord = vertexTexCoord;
     fragColor = vertexColor;
 
@@ -55,5 +59,5 @@ void main()
     fragNormal = normalize(normalMatrix*vertexNormal);
 
     // Calculate final vertex position
-    gl_Position = mvp*vec4(vertexPosition, 1.0);
+    gl_Position = mvp*vec4(position, 1.0);
 }
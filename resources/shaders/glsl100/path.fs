@@ -0,0 +1,11 @@
+#version 100
+
+precision mediump float;
+
+// Input vertex attributes (from vertex shader)
+varying vec4 fragColor;
+
+void main()
+{
+    gl_FragColor = fragColor;
+}
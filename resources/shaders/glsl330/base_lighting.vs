@@ -0,0 +1,38 @@
+#version 330
+
+// Input vertex attributes
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec3 vertexNormal;
+in vec4 vertexColor;
+
+// Input uniform values
+uniform mat4 mvp;
+uniform mat4 matModel;
+uniform vec3 meshOrigin;    // compact meshes store positions quantized to 16 bits,
+uniform vec3 meshStep;      // float ones use a zero origin and a step of one
+
+// Output vertex attributes (to fragment shader)
+out vec3 fragPosition;
+out vec2 fragTexCoord;
+out vec4 fragColor;
+out vec3 fragNormal;
+
+// NOTE: Add here your custom variables
+
+void main()
+{
+    vec3 position = meshOrigin + vertexPosition*meshStep;
+
+    // Send vertex attributes to fragment shader
+    fragPosition = vec3(matModel*vec4(position, 1.0));
+    fragTexCoord = vertexTexCoord;
+    fragColor = vertexColor;
+
+    // compact meshes are drawn without raylib, which is what sets matNormal
+    mat3 normalMatrix = transpose(inverse(mat3(matModel)));
+    fragNormal = normalize(normalMatrix*vertexNormal);
+
+    // Calculate final vertex position
+    gl_Position = mvp*vec4(position, 1.0);
+}
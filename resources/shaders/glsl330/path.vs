@@ -0,0 +1,36 @@
+#version 330
+
+// Input vertex attributes
+in vec3 vertexPosition;
+in vec4 vertexColor;
+in vec4 vertexNormal;    // feed, spindle speed, segment number and time, raylib only binds its own names
+
+// Input uniform values
+uniform mat4 mvp;
+uniform vec4 tint;          // color of the file the path came from
+uniform float tintAmount;   // 0 shows the move type colors, 1 only the file color
+uniform float colorByValue;  // 0 shows the move type colors, 1 colors by a value through the colormap
+uniform vec4 valueSelect;    // picks feed, spindle speed, segment number or time out of the values
+uniform float zSelect;       // 1 colors by z instead
+uniform vec2 valueRange;     // values mapped to the ends of the colormap
+uniform vec3 colormap[9];    // evenly spaced stops
+
+// Output vertex attributes (to fragment shader)
+out vec4 fragColor;
+
+vec3 valueColor(float value)
+{
+    float t = clamp((value - valueRange.x)/max(valueRange.y - valueRange.x, 0.000001), 0.0, 1.0)*8.0;
+    int i = int(min(t, 7.0));
+    return mix(colormap[i], colormap[i + 1], t - float(i));
+}
+
+void main()
+{
+    float value = dot(vertexNormal, valueSelect) + vertexPosition.z*zSelect;
+    vec3 color = mix(vertexColor.rgb, valueColor(value), colorByValue);
+    fragColor = vec4(mix(color, tint.rgb, tintAmount), vertexColor.a);
+
+    // Calculate final vertex position
+    gl_Position = mvp*vec4(vertexPosition, 1.0);
+}
@@ -0,0 +1,491 @@
+//all the gcode and stl files passed on the command line
+//every file is parsed on its own thread at startup, the gpu uploads then happen on the main thread
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <pthread.h>
+#include "toolpath.h"
+#include "out_of_core.h"
+#include "stl_loader.h"
+#include "stl_check.h"
+
+//12 bytes instead of the 32 the float mesh takes on the gpu, the position is quantized inside the model box
+typedef struct CompactMeshVertex{
+	unsigned short x, y, z, pad;
+	signed char nx, ny, nz, npad;
+}CompactMeshVertex;
+
+typedef struct ModelFile{
+	char *file;
+	Mesh mesh;	//the float arrays are dropped once a compact model is uploaded
+	Model model;	//only used for the float mesh
+	Texture texture;
+	Color color;
+	bool visible;
+	BoundingBox bounds;
+
+	Shader shader;
+	int origin_loc;	//position = meshOrigin + vertexPosition*meshStep
+	int step_loc;
+	bool compact;
+	unsigned int vao;
+	unsigned int vbo;
+	int vertex_count;
+	Vector3 origin;
+	Vector3 step;
+
+	bool check;	//look for holes and the like while reading
+	StlReport report;
+}ModelFile;
+
+typedef struct Session{
+	Toolpath *toolpaths;
+	int toolpath_count;
+	ModelFile *models;
+	int model_count;
+	int colors_used;	//toolpaths and models take their colors from the same list so no two files share one
+	bool compact;	//store the geometry quantized, about half the memory
+	bool stream;	//show stdin and pipes while they are still being written instead of waiting for the end
+	bool check_models;	//run stl_check on every model as it is read
+	size_t ooc_budget;	//keep the programs on disk and only this many bytes of them in memory, 0 keeps them all in memory
+}Session;
+
+//colors handed out to files in the order they are given, toolpaths and models alike
+static const Color file_colors[] = {
+	{187, 35, 255, 255},	//purple
+	{255, 161, 0, 255},	//orange
+	{0, 228, 255, 255},	//cyan
+	{255, 109, 194, 255},	//pink
+	{0, 228, 48, 255},	//green
+	{230, 41, 55, 255},	//red
+	{102, 191, 255, 255},	//light blue
+	{211, 176, 131, 255},	//beige
+};
+#define FILE_COLOR_COUNT (sizeof(file_colors)/sizeof(file_colors[0]))
+
+void session_add_gcode(Session *s, char *file){
+	s->toolpaths = (Toolpath *)realloc(s->toolpaths, sizeof(Toolpath)*(s->toolpath_count + 1));
+	if(s->toolpaths == NULL){
+		perror("Could not allocate space for the toolpaths!");
+		exit(-1);
+	}
+	s->toolpaths[s->toolpath_count] = (Toolpath){
+		.file = file,
+		.color = file_colors[s->colors_used++ % FILE_COLOR_COUNT],
+		.visible = true
+	};
+	s->toolpath_count++;
+}
+
+void session_add_model(Session *s, char *file){
+	s->models = (ModelFile *)realloc(s->models, sizeof(ModelFile)*(s->model_count + 1));
+	if(s->models == NULL){
+		perror("Could not allocate space for the models!");
+		exit(-1);
+	}
+	s->models[s->model_count] = (ModelFile){
+		.file = file,
+		.color = file_colors[s->colors_used++ % FILE_COLOR_COUNT],
+		.visible = true
+	};
+	s->model_count++;
+}
+
+static void *parse_gcode_thread(void *arg){
+	Toolpath *tp = (Toolpath *)arg;
+	if(tp->ooc) PROFILE("parse") tp->len = ooc_parse_gcode(tp);
+	else PROFILE("parse") tp->len = parse_gcode(tp->file, &tp->path, &tp->lines);
+	if(tp->len < 0) exit(-1);	//the window shows every file or none
+	return NULL;
+}
+
+static void *tessellate_thread(void *arg){
+	PROFILE("tessellate") toolpath_tessellate((Toolpath *)arg);
+	return NULL;
+}
+
+static void *read_model_thread(void *arg){
+	ModelFile *m = (ModelFile *)arg;
+	unsigned int claimed = 0;
+	PROFILE("stl load") m->mesh = read_stl_counted(m->file, &claimed);
+	m->bounds = GetMeshBoundingBox(m->mesh);
+	//the compact upload drops the float arrays, so this is the only chance
+	if(m->check) PROFILE("stl check") m->report = stl_check(&m->mesh, claimed, 0);
+	return NULL;
+}
+
+#define LIVE_READ_SIZE (64 << 10)	//parsed in one go while holding the lock, small enough not to hold up a frame
+
+static void *live_read_thread(void *arg){
+	Toolpath *tp = (Toolpath *)arg;
+	LiveSource *live = tp->live;
+
+	GcodeStream *g = gcode_stream_open(tp->file);
+	if(g == NULL){
+		printf("Gcode file: \"%s\" does not exist!", tp->file);
+		exit(-1);
+	}
+	char *buf = (char *)malloc(LIVE_READ_SIZE);
+	if(buf == NULL){
+		perror("Could not allocate space for reading!");
+		exit(-1);
+	}
+
+	//closing the window cancels this while it waits for more input, never while the parser is half way through,
+	//the stream is then left open for the exit to clean up since its own thread may be stuck on the pipe too
+	size_t n;
+	while((n = gcode_stream_read(g, buf, LIVE_READ_SIZE)) > 0){
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		pthread_mutex_lock(&live->lock);
+		PROFILE("parse") gcode_parser_feed(&live->parser, buf, n);
+		pthread_mutex_unlock(&live->lock);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	}
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_mutex_lock(&live->lock);
+	gcode_parser_finish(&live->parser);
+	gcode_parser_apply_kinematics(&live->parser);
+	live->done = true;
+	pthread_mutex_unlock(&live->lock);
+
+	gcode_stream_close(g);
+	free(buf);
+	return NULL;
+}
+
+static void session_start_live(Toolpath *tp){
+	tp->live = (LiveSource *)calloc(1, sizeof(LiveSource));
+	if(tp->live == NULL){
+		perror("Could not allocate space for the stream!");
+		exit(-1);
+	}
+	gcode_parser_init(&tp->live->parser, &tp->live->lines);
+	pthread_mutex_init(&tp->live->lock, NULL);
+	pthread_create(&tp->live->thread, NULL, live_read_thread, tp);
+	printf("Reading %s as it arrives\n", tp->file);
+}
+
+static void live_free(LiveSource *live){
+	free(live->parser.segments);
+	free(live->parser.rotary);
+	arc_batch_free(&live->parser.arcs);
+	line_index_free(&live->lines);
+	pthread_mutex_destroy(&live->lock);
+	free(live);
+}
+
+//read and parse every file in parallel, this does not need a window
+//with stream set, stdin and pipes keep being read in the background and session_poll picks up their moves
+void session_parse(Session *s){
+	int count = s->toolpath_count + s->model_count;
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*count);
+	bool *started = (bool *)calloc(count + 1, sizeof(bool));
+
+	for(int i=0; i<s->toolpath_count; i++){
+		if(s->stream && gcode_stream_is_live(s->toolpaths[i].file)) session_start_live(&s->toolpaths[i]);
+		else{
+			if(s->ooc_budget) s->toolpaths[i].ooc = ooc_new(s->ooc_budget, s->compact);
+			started[i] = pthread_create(&threads[i], NULL, parse_gcode_thread, &s->toolpaths[i]) == 0;
+		}
+	}
+	for(int i=0; i<s->model_count; i++){
+		s->models[i].check = s->check_models;
+		started[s->toolpath_count + i] = pthread_create(&threads[s->toolpath_count + i], NULL, read_model_thread, &s->models[i]) == 0;
+	}
+
+	for(int i=0; i<count; i++) if(started[i]) pthread_join(threads[i], NULL);
+	free(threads);
+	free(started);
+}
+
+//copy the moves parsed since the last frame into the live paths and onto the gpu,
+//a path that reached the end of its input is rebuilt like any other file, true when that happened
+bool session_poll(Session *s){
+	bool finished = false;
+	for(int i=0; i<s->toolpath_count; i++){
+		Toolpath *tp = &s->toolpaths[i];
+		LiveSource *live = tp->live;
+		if(live == NULL) continue;
+
+		int from = tp->len;
+		pthread_mutex_lock(&live->lock);
+		if(live->parser.kinematic && from > 0){	//renumbered at the end, start over
+			from = tp->len = 0;
+			line_index_free(&tp->lines);
+		}
+		int count = live->parser.count;
+		if(count > live->path_cap){
+			live->path_cap = count*2;
+			tp->path = (Segment *)realloc(tp->path, sizeof(Segment)*live->path_cap);
+			if(tp->path == NULL){
+				perror("Could not allocate more space for segments!");
+				exit(-1);
+			}
+		}
+		memcpy(tp->path + from, live->parser.segments + from, sizeof(Segment)*(count - from));
+		for(int n=from; n<count; n++){
+			uint32_t line;
+			uint64_t offset;
+			line_index_get(&live->lines, n, &line, &offset);
+			line_index_push(&tp->lines, line, offset);
+		}
+		tp->len = count;
+		bool done = live->done;
+		pthread_mutex_unlock(&live->lock);
+
+		if(tp->len > from && !done) PROFILE("append") toolpath_append(tp, from);	//done gets rebuilt below
+		if(!done) continue;
+
+		pthread_join(live->thread, NULL);
+		live_free(live);
+		tp->live = NULL;
+		printf("Finished reading %s, %d points\n", tp->file, tp->len);
+
+		//from here on it is an ordinary path with a layer index
+		if(tp->vao) rlUnloadVertexArray(tp->vao);
+		if(tp->vbo) rlUnloadVertexBuffer(tp->vbo);
+		tp->vao = tp->vbo = 0;
+		tp->gpu_cap = 0;
+		tp->compact = s->compact;
+		PROFILE("tessellate") toolpath_tessellate(tp);
+		PROFILE("upload") toolpath_upload(tp);
+		finished = true;
+	}
+	return finished;
+}
+
+static void model_set_attributes(void){
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 3, GL_UNSIGNED_SHORT, false, sizeof(CompactMeshVertex), 0);
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, 3, GL_BYTE, true, sizeof(CompactMeshVertex), offsetof(CompactMeshVertex, nx));
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL);
+}
+
+//quantize the mesh and upload it in place of the float arrays, which are freed
+static void model_upload_compact(ModelFile *m){
+	Mesh *mesh = &m->mesh;
+	m->origin = m->bounds.min;
+	m->step = Vector3Scale(Vector3Subtract(m->bounds.max, m->bounds.min), 1.0f/65535.0f);
+	Vector3 inv = {m->step.x > 0 ? 1.0f/m->step.x : 0, m->step.y > 0 ? 1.0f/m->step.y : 0, m->step.z > 0 ? 1.0f/m->step.z : 0};
+
+	CompactMeshVertex *v = (CompactMeshVertex *)malloc(sizeof(CompactMeshVertex)*(mesh->vertexCount + 1));
+	if(v == NULL){
+		perror("Could not allocate space for the compact model!");
+		exit(-1);
+	}
+	for(int i=0; i<mesh->vertexCount; i++){
+		float *p = &mesh->vertices[i*3], *n = &mesh->normals[i*3];
+		v[i] = (CompactMeshVertex){
+			(unsigned short)((p[0] - m->origin.x)*inv.x + 0.5f),
+			(unsigned short)((p[1] - m->origin.y)*inv.y + 0.5f),
+			(unsigned short)((p[2] - m->origin.z)*inv.z + 0.5f),
+			0,
+			(signed char)lroundf(Clamp(n[0], -1.0f, 1.0f)*127.0f),
+			(signed char)lroundf(Clamp(n[1], -1.0f, 1.0f)*127.0f),
+			(signed char)lroundf(Clamp(n[2], -1.0f, 1.0f)*127.0f),
+			0
+		};
+	}
+
+	m->vao = rlLoadVertexArray();
+	rlEnableVertexArray(m->vao);
+	m->vbo = rlLoadVertexBuffer(v, sizeof(CompactMeshVertex)*mesh->vertexCount, false);
+	model_set_attributes();
+	rlDisableVertexArray();
+	free(v);
+
+	m->vertex_count = mesh->vertexCount;
+	RL_FREE(mesh->vertices);
+	RL_FREE(mesh->normals);
+	RL_FREE(mesh->texcoords);
+	RL_FREE(mesh->vboId);
+	*mesh = (Mesh){0};
+}
+
+//build the gpu buffers for everything parsed, model_shader is used to light the models
+void session_upload(Session *s, Shader model_shader){
+	//live paths are uploaded bit by bit in session_poll
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*(s->toolpath_count + 1));
+	for(int i=0; i<s->toolpath_count; i++){
+		if(s->toolpaths[i].live) continue;
+		s->toolpaths[i].compact = s->compact;
+		pthread_create(&threads[i], NULL, tessellate_thread, &s->toolpaths[i]);
+	}
+	for(int i=0; i<s->toolpath_count; i++) if(!s->toolpaths[i].live) pthread_join(threads[i], NULL);
+	free(threads);
+
+	PROFILE("upload") for(int i=0; i<s->toolpath_count; i++) if(!s->toolpaths[i].live) toolpath_upload(&s->toolpaths[i]);
+	for(int i=0; i<s->toolpath_count; i++) if(s->toolpaths[i].ooc) ooc_upload(&s->toolpaths[i]);
+
+	for(int i=0; i<s->model_count; i++){
+		ModelFile *m = &s->models[i];
+		m->shader = model_shader;
+		m->origin_loc = GetShaderLocation(model_shader, "meshOrigin");
+		m->step_loc = GetShaderLocation(model_shader, "meshStep");
+
+		Image texture_image = GenImageColor(1.0f, 1.0f, m->color);
+		m->texture = LoadTextureFromImage(texture_image);
+		UnloadImage(texture_image);
+
+		m->compact = s->compact;
+		if(m->compact){
+			PROFILE("upload") model_upload_compact(m);
+			continue;
+		}
+
+		PROFILE("upload") UploadMesh(&m->mesh, false);
+		m->model = LoadModelFromMesh(m->mesh);
+		m->model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = m->texture;
+		m->model.materials[0].shader = model_shader;
+	}
+}
+
+void session_free(Session *s){
+	for(int i=0; i<s->toolpath_count; i++){
+		LiveSource *live = s->toolpaths[i].live;
+		if(live){	//still waiting on its input
+			pthread_cancel(live->thread);
+			pthread_join(live->thread, NULL);
+			live_free(live);
+		}
+		if(s->toolpaths[i].ooc) ooc_free(s->toolpaths[i].ooc);
+		toolpath_free(&s->toolpaths[i]);
+	}
+	for(int i=0; i<s->model_count; i++){
+		ModelFile *m = &s->models[i];
+		if(m->compact){
+			rlUnloadVertexArray(m->vao);
+			rlUnloadVertexBuffer(m->vbo);
+			UnloadTexture(m->texture);
+		}
+		else if(m->model.meshCount > 0){
+			UnloadModel(m->model);
+			UnloadTexture(m->texture);
+		}
+		else{	//parsed but never uploaded
+			RL_FREE(m->mesh.vertices);
+			RL_FREE(m->mesh.normals);
+			RL_FREE(m->mesh.texcoords);
+			RL_FREE(m->mesh.vboId);
+		}
+	}
+	free(s->toolpaths);
+	free(s->models);
+	*s = (Session){0};
+}
+
+//draw a model at the origin, the float mesh goes through raylib and the compact one is drawn by hand
+void DrawModelFile(ModelFile *m, Color tint){
+	Vector3 origin = m->compact ? m->origin : Vector3Zero();
+	Vector3 step = m->compact ? m->step : Vector3One();
+	SetShaderValue(m->shader, m->origin_loc, &origin, SHADER_UNIFORM_VEC3);
+	SetShaderValue(m->shader, m->step_loc, &step, SHADER_UNIFORM_VEC3);
+
+	if(!m->compact){
+		DrawModel(m->model, Vector3Zero(), scale, tint);
+		profile_count_draw(m->mesh.vertexCount);
+		return;
+	}
+
+	rlDrawRenderBatchActive();
+	profile_count_flush(true);
+
+	Matrix transform = MatrixScale(scale, scale, scale);
+	Matrix mvp = MatrixMultiply(MatrixMultiply(transform, rlGetMatrixModelview()), rlGetMatrixProjection());
+	Vector4 color = ColorNormalize(tint);
+	int slot = 0;
+
+	rlEnableShader(m->shader.id);
+	rlSetUniformMatrix(m->shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+	rlSetUniformMatrix(m->shader.locs[SHADER_LOC_MATRIX_MODEL], transform);
+	rlSetUniform(m->shader.locs[SHADER_LOC_COLOR_DIFFUSE], &color, SHADER_UNIFORM_VEC4, 1);
+	rlActiveTextureSlot(0);
+	rlEnableTexture(m->texture.id);
+	rlSetUniform(m->shader.locs[SHADER_LOC_MAP_DIFFUSE], &slot, SHADER_UNIFORM_INT, 1);
+
+	if(!rlEnableVertexArray(m->vao)){	//no vertex array objects on this platform
+		rlEnableVertexBuffer(m->vbo);
+		model_set_attributes();
+	}
+	rlDrawVertexArray(0, m->vertex_count);
+	profile_count_draw(m->vertex_count);
+
+	rlDisableVertexArray();
+	rlDisableVertexBuffer();
+	rlDisableTexture();
+	rlDisableShader();
+}
+
+//number keys toggle the files in the order they are listed in the legend
+void CheckSessionInputs(Session *s){
+	for(int key = KEY_ONE; key <= KEY_NINE; key++){
+		if(!IsKeyPressed(key)) continue;
+		int n = key - KEY_ONE;
+		if(n < s->toolpath_count) s->toolpaths[n].visible = !s->toolpaths[n].visible;
+		else if(n - s->toolpath_count < s->model_count) s->models[n - s->toolpath_count].visible = !s->models[n - s->toolpath_count].visible;
+	}
+}
+
+//range of the value the paths are colored by over every visible path, so a value gets the same color in all of them
+void session_value_range(Session *s, PathColoring *c){
+	c->min = INFINITY;
+	c->max = -INFINITY;
+	for(int i=0; i<s->toolpath_count; i++){
+		Toolpath *tp = &s->toolpaths[i];
+		if(!tp->visible || tp->vertex_count == 0) continue;
+		c->min = fminf(c->min, tp->value_min[c->mode]);
+		c->max = fmaxf(c->max, tp->value_max[c->mode]);
+	}
+	if(c->min > c->max) c->min = c->max = 0;
+}
+
+void DrawSessionLegend(Session *s, int active){
+	if(s->toolpath_count + s->model_count < 2) return;
+
+	int y = 10;
+	for(int i=0; i<s->toolpath_count + s->model_count; i++, y += 20){
+		bool is_path = i < s->toolpath_count;
+		char *file = is_path ? s->toolpaths[i].file : s->models[i - s->toolpath_count].file;
+		Color color = is_path ? s->toolpaths[i].color : s->models[i - s->toolpath_count].color;
+		bool visible = is_path ? s->toolpaths[i].visible : s->models[i - s->toolpath_count].visible;
+
+		if(!visible) color = GRAY;
+		DrawRectangle(10, y + 3, 10, 10, color);
+		DrawText(TextFormat("%s%d %s", (is_path && i == active) ? ">" : " ", i + 1, GetFileName(file)), 26, y, 16, color);
+	}
+}
+
+//what stl_check found in every model, under the file legend
+void DrawModelReports(Session *s, bool dark_mode){
+	Color fg = dark_mode ? LIGHTGRAY : DARKGRAY;
+	int files = s->toolpath_count + s->model_count;
+	int x = 10, y = 10 + (files < 2 ? 0 : files*20) + 6;
+
+	for(int i=0; i<s->model_count; i++){
+		ModelFile *m = &s->models[i];
+		StlReport *r = &m->report;
+		DrawText(GetFileName(m->file), x, y, 10, m->color);
+		y += 14;
+		if(!r->checked){
+			DrawText("not checked", x, y, 10, fg);
+			y += 18;
+			continue;
+		}
+		Vector3 size = Vector3Subtract(r->bounds.max, r->bounds.min);
+		DrawText(TextFormat("%u triangles%s", r->triangles, r->triangles != r->claimed ? TextFormat(" of %u, cut short", r->claimed) : ""), x, y, 10, fg);
+		y += 12;
+		DrawText(TextFormat("size %g x %g x %g", size.x, size.y, size.z), x, y, 10, fg);
+		y += 12;
+		DrawText(TextFormat("area %g  volume %g", r->area, r->volume), x, y, 10, fg);
+		y += 12;
+		DrawText(TextFormat("degenerate %ld  duplicate %ld  flipped %ld", r->degenerate, r->duplicate, r->flipped), x, y, 10, fg);
+		y += 12;
+		DrawText(TextFormat("open %ld  non-manifold %ld  misoriented %ld edges", r->open_edges, r->nonmanifold_edges, r->misoriented_edges), x, y, 10, fg);
+		y += 12;
+		DrawText(stl_report_ok(r) ? "watertight" : "NOT watertight", x, y, 10, stl_report_ok(r) ? GREEN : RED);
+		y += 18;
+	}
+}
+
+#endif //SESSION_H
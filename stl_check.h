@@ -0,0 +1,288 @@
+//checks the triangles of an stl before they are trusted: size, area, volume and the problems that make a scan
+//useless as stock or a fixture, holes, edges shared by more than two faces and faces wound the wrong way
+//the triangles are split into one range per core, the edges are found through a hash of their two corners,
+//split into buckets by its top bits so every thread counts its own buckets in a private table without locks
+#ifndef STL_CHECK_H
+#define STL_CHECK_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STL_CHECK_BUCKET_BITS 6	//64 buckets, more than there are cores so the threads finish together
+#define STL_CHECK_BUCKETS (1 << STL_CHECK_BUCKET_BITS)
+#define STL_CHECK_MAX_THREADS 64
+#define STL_CHECK_DEGENERATE 1e-6	//area below this fraction of the longest edge squared
+
+typedef struct StlReport{
+	bool checked;
+	unsigned int triangles;
+	unsigned int claimed;	//count in the header, more than were read when the file is cut short
+	BoundingBox bounds;
+	double area;	//stl units squared
+	double volume;	//negative when the faces point inwards, only means something when the surface is closed
+	long degenerate;	//no area, the corners are on a line or on top of each other
+	long duplicate;	//same corners as another triangle, once for every extra copy
+	long flipped;	//the normal in the file points against the one from the winding
+	long open_edges;	//used by one triangle, a hole
+	long nonmanifold_edges;	//used by more than two
+	long misoriented_edges;	//two triangles run along it the same way, one of them is wound backwards
+	double seconds;
+}StlReport;
+
+//one entry per distinct key in a bucket
+typedef struct StlEdgeCount{
+	uint64_t key;	//0 is empty
+	unsigned int uses;
+	unsigned int forward;	//uses going from the lower corner to the higher
+}StlEdgeCount;
+
+typedef struct StlCheckJob{
+	const Mesh *mesh;
+	int thread, threads;
+	unsigned int first, last;	//triangle range
+	StlReport part;	//sums of the range
+	long edge_count[STL_CHECK_BUCKETS];	//then the offset of the range in each bucket
+	long tri_count[STL_CHECK_BUCKETS];
+	uint64_t *edges;	//shared, bucket after bucket
+	uint64_t *tris;
+	long *edge_start;	//STL_CHECK_BUCKETS + 1 offsets, shared
+	long *tri_start;
+}StlCheckJob;
+
+static inline uint64_t stl_mix(uint64_t h){
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	return h ^ (h >> 33);
+}
+
+//same for every copy of a corner, welded on the exact coordinates like the slicers do
+static inline uint64_t stl_vertex_key(const float *v){
+	uint32_t b[3];
+	for(int i=0; i<3; i++){
+		float f = v[i] + 0.0f;	//-0 and 0 are the same corner
+		memcpy(&b[i], &f, sizeof(f));
+	}
+	return stl_mix(((uint64_t)b[0] << 32 | b[1]) ^ stl_mix(b[2] + 0x9e3779b97f4a7c15ULL));
+}
+
+//the same for both directions, the lowest bit says which way this one runs
+static inline uint64_t stl_edge_key(uint64_t a, uint64_t b){
+	uint64_t lo = a < b ? a : b, hi = a < b ? b : a;
+	return (stl_mix(lo ^ stl_mix(hi)) & ~1ULL) | (a < b);
+}
+
+static inline uint64_t stl_triangle_key(uint64_t a, uint64_t b, uint64_t c){
+	uint64_t t;
+	if(a > b){ t = a; a = b; b = t; }
+	if(b > c){ t = b; b = c; c = t; }
+	if(a > b){ t = a; a = b; b = t; }
+	return stl_mix(a ^ stl_mix(b ^ stl_mix(c))) | 2;	//never 0, the empty slot
+}
+
+static inline int stl_bucket(uint64_t key){
+	return key >> (64 - STL_CHECK_BUCKET_BITS);
+}
+
+//calls emit for the three edges and the triangle key, zero length edges are left out
+#define STL_FOR_KEYS(v, t, EDGE, TRI) do{ \
+	uint64_t _k[3]; \
+	for(int _c=0; _c<3; _c++) _k[_c] = stl_vertex_key(&(v)[(t)*9 + _c*3]); \
+	for(int _c=0; _c<3; _c++) if(_k[_c] != _k[(_c + 1) % 3]){ uint64_t key = stl_edge_key(_k[_c], _k[(_c + 1) % 3]); EDGE; } \
+	{ uint64_t key = stl_triangle_key(_k[0], _k[1], _k[2]); TRI; } \
+}while(0)
+
+//sums of the range and how many keys it puts in every bucket
+static void *stl_check_measure(void *arg){
+	StlCheckJob *j = (StlCheckJob *)arg;
+	const float *v = j->mesh->vertices, *n = j->mesh->normals;
+	StlReport *r = &j->part;
+	r->bounds = (BoundingBox){{v[j->first*9], v[j->first*9 + 1], v[j->first*9 + 2]}, {v[j->first*9], v[j->first*9 + 1], v[j->first*9 + 2]}};
+
+	for(unsigned int t=j->first; t<j->last; t++){
+		const float *p = &v[t*9];
+		for(int c=0; c<9; c += 3){
+			r->bounds.min = Vector3Min(r->bounds.min, (Vector3){p[c], p[c + 1], p[c + 2]});
+			r->bounds.max = Vector3Max(r->bounds.max, (Vector3){p[c], p[c + 1], p[c + 2]});
+		}
+
+		double ax = p[3] - p[0], ay = p[4] - p[1], az = p[5] - p[2];
+		double bx = p[6] - p[0], by = p[7] - p[1], bz = p[8] - p[2];
+		double cx = p[6] - p[3], cy = p[7] - p[4], cz = p[8] - p[5];
+		double nx = ay*bz - az*by, ny = az*bx - ax*bz, nz = ax*by - ay*bx;
+		double twice_area = sqrt(nx*nx + ny*ny + nz*nz);
+		double longest = fmax(ax*ax + ay*ay + az*az, fmax(bx*bx + by*by + bz*bz, cx*cx + cy*cy + cz*cz));
+
+		r->area += twice_area*0.5;
+		r->volume += (p[0]*nx + p[1]*ny + p[2]*nz)/6.0;	//tetrahedron to the origin
+		if(twice_area <= STL_CHECK_DEGENERATE*longest) r->degenerate++;
+		else if(n && n[t*9]*nx + n[t*9 + 1]*ny + n[t*9 + 2]*nz < 0) r->flipped++;
+
+		STL_FOR_KEYS(v, t, j->edge_count[stl_bucket(key)]++, j->tri_count[stl_bucket(key)]++);
+	}
+	return NULL;
+}
+
+//every range writes its keys into its own slice of each bucket
+static void *stl_check_scatter(void *arg){
+	StlCheckJob *j = (StlCheckJob *)arg;
+	const float *v = j->mesh->vertices;
+	for(unsigned int t=j->first; t<j->last; t++)
+		STL_FOR_KEYS(v, t, j->edges[j->edge_count[stl_bucket(key)]++] = key, j->tris[j->tri_count[stl_bucket(key)]++] = key);
+	return NULL;
+}
+
+//count how often every key shows up in keys, table has room for twice as many
+static int stl_count_keys(const uint64_t *keys, long count, StlEdgeCount *table, long size, bool directed){
+	long mask = size - 1;
+	int distinct = 0;
+	memset(table, 0, sizeof(StlEdgeCount)*size);
+	for(long i=0; i<count; i++){
+		uint64_t key = directed ? keys[i] | 1 : keys[i];
+		long slot = (key >> 1) & mask;
+		while(table[slot].key != 0 && table[slot].key != key) slot = (slot + 1) & mask;
+		if(table[slot].key == 0) distinct++;
+		table[slot].key = key;
+		table[slot].uses++;
+		table[slot].forward += directed ? keys[i] & 1 : 0;
+	}
+	return distinct;
+}
+
+//threads take the buckets in turn, the table is sized for the biggest one it gets
+static void *stl_check_count(void *arg){
+	StlCheckJob *j = (StlCheckJob *)arg;
+	StlReport *r = &j->part;
+	long largest = 0;
+	for(int b=j->thread; b<STL_CHECK_BUCKETS; b += j->threads){
+		long edges = j->edge_start[b + 1] - j->edge_start[b], tris = j->tri_start[b + 1] - j->tri_start[b];
+		if(edges > largest) largest = edges;
+		if(tris > largest) largest = tris;
+	}
+	long size = 16;
+	while(size < largest*2) size *= 2;
+	StlEdgeCount *table = (StlEdgeCount *)malloc(sizeof(StlEdgeCount)*size);
+	if(table == NULL){
+		perror("Could not allocate space for the edge table!");
+		exit(-1);
+	}
+
+	for(int b=j->thread; b<STL_CHECK_BUCKETS; b += j->threads){
+		stl_count_keys(j->edges + j->edge_start[b], j->edge_start[b + 1] - j->edge_start[b], table, size, true);
+		for(long i=0; i<size; i++){
+			StlEdgeCount *e = &table[i];
+			if(e->uses == 1) r->open_edges++;
+			else if(e->uses > 2) r->nonmanifold_edges++;
+			else if(e->uses == 2 && e->forward != 1) r->misoriented_edges++;
+		}
+		long tris = j->tri_start[b + 1] - j->tri_start[b];
+		r->duplicate += tris - stl_count_keys(j->tris + j->tri_start[b], tris, table, size, false);
+	}
+	free(table);
+	return NULL;
+}
+
+static void stl_check_run(StlCheckJob *jobs, int threads, void *(*pass)(void *)){
+	pthread_t thread[STL_CHECK_MAX_THREADS];
+	for(int i=1; i<threads; i++) pthread_create(&thread[i], NULL, pass, &jobs[i]);
+	pass(&jobs[0]);
+	for(int i=1; i<threads; i++) pthread_join(thread[i], NULL);
+}
+
+//threads 0 uses every core, claimed is the count from the header
+StlReport stl_check(const Mesh *mesh, unsigned int claimed, int threads){
+	StlReport r = { .checked = true, .triangles = mesh->triangleCount, .claimed = claimed };
+	if(mesh->triangleCount == 0 || mesh->vertices == NULL) return r;
+	double start = profiler_now();
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1) threads = 1;
+	if(threads > STL_CHECK_MAX_THREADS) threads = STL_CHECK_MAX_THREADS;
+	if((unsigned int)threads > mesh->triangleCount) threads = mesh->triangleCount;
+
+	StlCheckJob *jobs = (StlCheckJob *)calloc(threads, sizeof(StlCheckJob));
+	long edge_start[STL_CHECK_BUCKETS + 1], tri_start[STL_CHECK_BUCKETS + 1];
+	uint64_t *edges = (uint64_t *)malloc(sizeof(uint64_t)*mesh->triangleCount*3);
+	uint64_t *tris = (uint64_t *)malloc(sizeof(uint64_t)*mesh->triangleCount);
+	if(jobs == NULL || edges == NULL || tris == NULL){
+		perror("Could not allocate space for checking the model!");
+		exit(-1);
+	}
+
+	for(int i=0; i<threads; i++){
+		jobs[i] = (StlCheckJob){
+			.mesh = mesh, .thread = i, .threads = threads,
+			.first = (unsigned int)((uint64_t)mesh->triangleCount*i/threads),
+			.last = (unsigned int)((uint64_t)mesh->triangleCount*(i + 1)/threads),
+			.edges = edges, .tris = tris, .edge_start = edge_start, .tri_start = tri_start
+		};
+	}
+	stl_check_run(jobs, threads, stl_check_measure);
+
+	//bucket by bucket, and in range order inside a bucket
+	long edge_total = 0, tri_total = 0;
+	for(int b=0; b<STL_CHECK_BUCKETS; b++){
+		edge_start[b] = edge_total;
+		tri_start[b] = tri_total;
+		for(int i=0; i<threads; i++){
+			long e = jobs[i].edge_count[b], t = jobs[i].tri_count[b];
+			jobs[i].edge_count[b] = edge_total;
+			jobs[i].tri_count[b] = tri_total;
+			edge_total += e;
+			tri_total += t;
+		}
+	}
+	edge_start[STL_CHECK_BUCKETS] = edge_total;
+	tri_start[STL_CHECK_BUCKETS] = tri_total;
+	stl_check_run(jobs, threads, stl_check_scatter);
+
+	r.bounds = jobs[0].part.bounds;
+	for(int i=0; i<threads; i++){
+		StlReport *p = &jobs[i].part;
+		r.bounds.min = Vector3Min(r.bounds.min, p->bounds.min);
+		r.bounds.max = Vector3Max(r.bounds.max, p->bounds.max);
+		r.area += p->area;
+		r.volume += p->volume;
+		r.degenerate += p->degenerate;
+		r.flipped += p->flipped;
+		jobs[i].part = (StlReport){0};
+	}
+	stl_check_run(jobs, threads, stl_check_count);
+
+	for(int i=0; i<threads; i++){
+		StlReport *p = &jobs[i].part;
+		r.duplicate += p->duplicate;
+		r.open_edges += p->open_edges;
+		r.nonmanifold_edges += p->nonmanifold_edges;
+		r.misoriented_edges += p->misoriented_edges;
+	}
+
+	free(edges);
+	free(tris);
+	free(jobs);
+	r.seconds = (profiler_now() - start)/1e6;
+	return r;
+}
+
+//closed and not empty, every edge has exactly two faces running along it in opposite directions and nothing is missing from the file
+bool stl_report_ok(const StlReport *r){
+	return r->triangles > 0 && r->triangles == r->claimed && r->duplicate == 0 && r->open_edges == 0 && r->nonmanifold_edges == 0 && r->misoriented_edges == 0;
+}
+
+void stl_report_print(const char *file, const StlReport *r){
+	Vector3 size = Vector3Subtract(r->bounds.max, r->bounds.min);
+	printf("%s: %u triangles, checked in %.2fs\n", file, r->triangles, r->seconds);
+	if(r->triangles != r->claimed) printf("  file is cut short, the header says %u triangles\n", r->claimed);
+	printf("  bounds    %g, %g, %g to %g, %g, %g (%g x %g x %g)\n", r->bounds.min.x, r->bounds.min.y, r->bounds.min.z,
+			r->bounds.max.x, r->bounds.max.y, r->bounds.max.z, size.x, size.y, size.z);
+	printf("  area      %g\n", r->area);
+	printf("  volume    %g%s\n", r->volume, r->open_edges || r->nonmanifold_edges ? " (not closed, only a rough figure)" : "");
+	printf("  degenerate %ld, duplicate %ld, flipped normals %ld\n", r->degenerate, r->duplicate, r->flipped);
+	printf("  open edges %ld, non-manifold edges %ld, misoriented edges %ld\n", r->open_edges, r->nonmanifold_edges, r->misoriented_edges);
+	printf("  %s\n", stl_report_ok(r) ? "watertight" : "NOT watertight");
+}
+
+#endif //STL_CHECK_H
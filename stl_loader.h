@@ -25,12 +25,14 @@ typedef struct vertex_info_t {
 } vertex_info_t;
 #pragma pack(pop)
 
-Mesh load_stl(char *file_path) {
+//reads the file into mesh arrays without touching the gpu, so it can run on a worker thread
+//a file cut short keeps the triangles that are there, claimed gets the count from the header
+Mesh read_stl_counted(char *file_path, unsigned int *claimed) {
     Mesh mesh = {0};
 
     mesh.vboId = (unsigned int *)RL_CALLOC(7, sizeof(unsigned int));
 
-    FILE *fap = fopen(file_path, "r");
+    FILE *fap = fopen(file_path, "rb");
 
 
     if(fap == NULL){
@@ -40,30 +42,36 @@ Mesh load_stl(char *file_path) {
 
     unsigned int triangle_count = 0;
 
+    fseek(fap, 0, SEEK_END);
+    long file_size = ftell(fap);
     fseek(fap, sizeof(__uint8_t) * 80, 0);
-    fread(&triangle_count, sizeof(int), 1, fap);
-    vertex_info_t *model_info = (vertex_info_t *) RL_MALLOC(triangle_count * sizeof(vertex_info_t));
+    if(fread(&triangle_count, sizeof(int), 1, fap) != 1) triangle_count = 0;
+    if(claimed) *claimed = triangle_count;
+
+    //a broken header can not make us allocate more than the file holds
+    unsigned long fits = file_size > 84 ? (unsigned long)(file_size - 84) / sizeof(vertex_info_t) : 0;
+    if(triangle_count > fits) triangle_count = fits;
+    vertex_info_t *model_info = (vertex_info_t *) RL_MALLOC(triangle_count * sizeof(vertex_info_t) + 1);
 
     if(model_info == NULL) {
         perror("Error creating model");
         exit(-1);
     }
 
-    mesh.vertexCount = triangle_count * 3;
-    mesh.triangleCount = triangle_count;
-    mesh.normals = (float *)RL_MALLOC(sizeof(Vector3) * triangle_count * 3);
-    mesh.vertices = (float *)RL_MALLOC(sizeof(Vector3) * triangle_count * 3);
-    mesh.texcoords = (float *)RL_MALLOC(sizeof(Vector3) * triangle_count * 3);
-
-
     size_t registers_read = fread(model_info, sizeof(vertex_info_t), triangle_count, fap);
 
-    if(registers_read < triangle_count) {
-        printf("Error. Unable to read the expected number of triangles: %zu out of %zu", registers_read, triangle_count);
-        exit(-1);
+    if(claimed && registers_read < *claimed) {
+        printf("Warning. Only %zu out of %u triangles could be read from %s\n", registers_read, *claimed, file_path);
     } else {
         printf("%zu triangles read\n", registers_read);
     }
+    triangle_count = registers_read;
+
+    mesh.vertexCount = triangle_count * 3;
+    mesh.triangleCount = triangle_count;
+    mesh.normals = (float *)RL_MALLOC(sizeof(Vector3) * triangle_count * 3);
+    mesh.vertices = (float *)RL_MALLOC(sizeof(Vector3) * triangle_count * 3);
+    mesh.texcoords = (float *)RL_MALLOC(sizeof(Vector3) * triangle_count * 3);
 
     for (int i = 0, t = 0; t < triangle_count; t++) {
         for(int vertex_index = 0; vertex_index < 3; vertex_index++){
@@ -81,11 +89,21 @@ Mesh load_stl(char *file_path) {
         }
     }
 
-    UploadMesh(&mesh, false);
     RL_FREE(model_info);
     fclose(fap);
     return mesh;
 }
 
+Mesh read_stl(char *file_path) {
+    unsigned int claimed;
+    return read_stl_counted(file_path, &claimed);
+}
+
+Mesh load_stl(char *file_path) {
+    Mesh mesh = read_stl(file_path);
+    UploadMesh(&mesh, false);
+    return mesh;
+}
+
 
 #endif //RAYLIB_FLECS_SPINE_STL_LOADER_H
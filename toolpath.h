@@ -0,0 +1,636 @@
+//a parsed gcode file and the line geometry it is drawn with
+//the path is tessellated once and kept on the gpu, so drawing it is a single draw call per frame
+#ifndef TOOLPATH_H
+#define TOOLPATH_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include "rlgl.h"
+#include "gcode.h"
+#include "line_index.h"
+#include "profiler.h"
+#include "colormap.h"
+
+#if defined(GRAPHICS_API_OPENGL_ES2)
+	#include <GLES2/gl2.h>
+#elif defined(__APPLE__)
+	#include <OpenGL/gl.h>
+#else
+	#include <GL/gl.h>
+#endif
+
+#define LAYER_TOLERANCE 0.001f	//z levels closer than this are the same layer
+#define MAX_LAYERS 4096	//paths with more z levels than this get them binned evenly
+#define PATH_CHUNK_VERTICES 65536	//vertices sharing one quantization box in the compact format, even so lines never straddle two
+#define PATH_PALETTE_SIZE 16	//colors a path can use and still be stored compact, keep in sync with path_compact.vs
+
+typedef struct PathVertex{
+	Vector3 position;
+	Color color;
+	Vector4 values;	//feed, spindle speed, segment number and time into the program, for coloring by them
+}PathVertex;
+
+//12 bytes instead of the 32 of a PathVertex: the position is quantized to 16 bits inside the box of its chunk,
+//w picks the color from the palette of the path and the values are quantized to 8 bits over the whole path,
+//plenty for coloring through a colormap of a few stops
+typedef struct CompactPathVertex{
+	unsigned short x, y, z, w;
+	unsigned char feed, spindle, order, time;
+}CompactPathVertex;
+
+//position = origin + quantized*step
+typedef struct PathChunk{
+	Vector3 origin;
+	Vector3 step;
+}PathChunk;
+
+typedef struct PathShader{
+	Shader shader;
+	int tint_loc;
+	int tint_amount_loc;
+	int origin_loc;	//only in the compact shader
+	int step_loc;
+	int palette_loc;
+	int values_origin_loc;
+	int values_step_loc;
+	int color_by_value_loc;
+	int value_select_loc;
+	int z_select_loc;
+	int value_range_loc;
+	int colormap_loc;
+}PathShader;
+
+PathShader path_shaders[2];	//indexed by Toolpath.compact
+
+//a program still arriving through a pipe, a reader thread feeds the parser and the main thread copies out what is new
+typedef struct LiveSource{
+	GcodeParser parser;
+	LineIndex lines;	//written by the parser
+	pthread_mutex_t lock;
+	pthread_t thread;
+	bool done;
+	int path_cap;	//room in the copy of the segments the toolpath draws from
+}LiveSource;
+
+//consecutive moves on the same layer with the same motion type, in path order
+typedef struct PathRun{
+	int first;	//first vertex
+	int count;
+	int layer;
+	unsigned char type;
+}PathRun;
+
+//which part of the paths to show
+typedef struct PathFilter{
+	float z_min, z_max;
+	unsigned char types;	//one bit per motion type, G0 is bit 0
+}PathFilter;
+
+typedef struct Toolpath{
+	char *file;
+	Segment *path;
+	int len;
+	LineIndex lines;
+	Color color;	//used when colouring by file
+	bool visible;
+
+	PathVertex *vertices;	//line list, only kept until it is uploaded, CompactPathVertex once compressed
+	int vertex_count;
+	int vertex_cap;
+	unsigned int vao;
+	unsigned int vbo;
+
+	bool compact;	//set before tessellating to ask for the compact format, cleared if the path does not fit it
+	PathChunk *chunks;
+	int chunk_count;
+	Vector4 palette[PATH_PALETTE_SIZE];
+	int palette_count;
+	Vector4 values_origin;	//values = origin + quantized*step
+	Vector4 values_step;
+
+	float value_min[COLOR_MODES];	//range of every value the path can be colored by
+	float value_max[COLOR_MODES];
+
+	float *layers;	//sorted z of every layer
+	int layer_count;
+	PathRun *runs;	//index of the vertex data by layer and motion type
+	int run_count;
+	int run_cap;
+	int *draw_first;	//ranges left by the current filter
+	int *draw_count;
+	int draw_ranges;
+	bool filtered;	//false draws everything in one go
+	PathFilter filter;	//the last one applied, no types before the first
+
+	int64_t segment_base;	//number of path[0] in the program, out of core chunks start further in
+	int64_t segment_total;	//segments in the program when path only holds a piece of it, for coloring by order
+	double time_base;	//seconds into the program at path[0]
+	double time;	//seconds into the program at the end of the last move tessellated
+	float *times;	//seconds into the program at every segment when the path can not work them out, the outline of an out of core program
+	struct OocPath *ooc;	//only for programs kept on disk, the path is then an outline of them
+
+	LiveSource *live;	//only while the program is still being read
+	int gpu_cap;	//vertices the buffer of a live path has room for
+}Toolpath;
+
+static void toolpath_add_line(Toolpath *tp, Vector3 a, Vector3 b, Segment *s, float order){
+	if(tp->vertex_count + 2 > tp->vertex_cap){
+		tp->vertex_cap = tp->vertex_cap ? tp->vertex_cap*2 : 4096;
+		tp->vertices = (PathVertex *)realloc(tp->vertices, sizeof(PathVertex)*tp->vertex_cap);
+		if(tp->vertices == NULL){
+			perror("Could not allocate more space for path vertices!");
+			exit(-1);
+		}
+	}
+	Vector4 values = {s->feed, s->spindle, order, tp->time};
+	tp->vertices[tp->vertex_count++] = (PathVertex){a, s->color, values};
+	tp->vertices[tp->vertex_count++] = (PathVertex){b, s->color, values};
+}
+
+static int compare_float(const void *a, const void *b){
+	float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+//collect the distinct z levels the path ends moves on
+static void toolpath_find_layers(Toolpath *tp){
+	float *z = (float *)malloc(sizeof(float)*(tp->len + 1));
+	if(z == NULL){
+		perror("Could not allocate space for the layers!");
+		exit(-1);
+	}
+	for(int n=0; n<tp->len; n++) z[n] = tp->path[n].point.z;
+	qsort(z, tp->len, sizeof(float), compare_float);
+
+	int count = 0;
+	for(int n=0; n<tp->len; n++){
+		if(count == 0 || z[n] - z[count-1] > LAYER_TOLERANCE) z[count++] = z[n];
+	}
+
+	//3d finishing paths have a different z on nearly every move, bin those so the index stays small
+	if(count > MAX_LAYERS){
+		float lo = z[0], step = (z[count-1] - z[0]) / (MAX_LAYERS - 1);
+		for(int i=0; i<MAX_LAYERS; i++) z[i] = lo + step*i;
+		count = MAX_LAYERS;
+	}
+
+	tp->layers = (float *)realloc(z, sizeof(float)*(count + 1));
+	tp->layer_count = count;
+}
+
+//layer a z value falls on, the closest one below it when it is between layers
+int toolpath_layer(Toolpath *tp, float z){
+	int lo = 0, hi = tp->layer_count - 1;
+	if(hi < 0) return 0;
+	while(lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if(tp->layers[mid] <= z + LAYER_TOLERANCE) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
+}
+
+static void toolpath_add_run(Toolpath *tp, int first, int count, int layer, unsigned char type){
+	if(count == 0) return;
+
+	PathRun *last = tp->run_count ? &tp->runs[tp->run_count-1] : NULL;
+	if(last && last->layer == layer && last->type == type && last->first + last->count == first){
+		last->count += count;
+		return;
+	}
+
+	if(tp->run_count == tp->run_cap){
+		tp->run_cap = tp->run_cap ? tp->run_cap*2 : 256;
+		tp->runs = (PathRun *)realloc(tp->runs, sizeof(PathRun)*tp->run_cap);
+		if(tp->runs == NULL){
+			perror("Could not allocate space for the layer index!");
+			exit(-1);
+		}
+	}
+	tp->runs[tp->run_count++] = (PathRun){first, count, layer, type};
+}
+
+static bool color_equal(Color a, Color b){
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+//rewrite the vertices in place as CompactPathVertex, false if the path has too many colors for the palette
+static bool toolpath_compress(Toolpath *tp){
+	Color colors[PATH_PALETTE_SIZE];
+	int color_count = 0;
+	for(int i=0; i<tp->vertex_count; i++){
+		Color c = tp->vertices[i].color;
+		int p = 0;
+		while(p < color_count && !color_equal(colors[p], c)) p++;
+		if(p == color_count){
+			if(color_count == PATH_PALETTE_SIZE) return false;
+			colors[color_count++] = c;
+		}
+	}
+	for(int p=0; p<color_count; p++) tp->palette[p] = ColorNormalize(colors[p]);
+	tp->palette_count = color_count;
+
+	tp->chunk_count = (tp->vertex_count + PATH_CHUNK_VERTICES - 1) / PATH_CHUNK_VERTICES;
+	tp->chunks = (PathChunk *)malloc(sizeof(PathChunk)*(tp->chunk_count + 1));
+	if(tp->chunks == NULL){
+		perror("Could not allocate space for the path chunks!");
+		exit(-1);
+	}
+
+	//the values get one box for the whole path
+	Vector4 v_lo = tp->vertex_count ? tp->vertices[0].values : (Vector4){0}, v_hi = v_lo;
+	for(int i=0; i<tp->vertex_count; i++){
+		Vector4 v = tp->vertices[i].values;
+		v_lo = (Vector4){fminf(v_lo.x, v.x), fminf(v_lo.y, v.y), fminf(v_lo.z, v.z), fminf(v_lo.w, v.w)};
+		v_hi = (Vector4){fmaxf(v_hi.x, v.x), fmaxf(v_hi.y, v.y), fmaxf(v_hi.z, v.z), fmaxf(v_hi.w, v.w)};
+	}
+	tp->values_origin = v_lo;
+	tp->values_step = (Vector4){(v_hi.x - v_lo.x)/255.0f, (v_hi.y - v_lo.y)/255.0f, (v_hi.z - v_lo.z)/255.0f, (v_hi.w - v_lo.w)/255.0f};
+	Vector4 v_inv = {
+		v_hi.x > v_lo.x ? 255.0f/(v_hi.x - v_lo.x) : 0,
+		v_hi.y > v_lo.y ? 255.0f/(v_hi.y - v_lo.y) : 0,
+		v_hi.z > v_lo.z ? 255.0f/(v_hi.z - v_lo.z) : 0,
+		v_hi.w > v_lo.w ? 255.0f/(v_hi.w - v_lo.w) : 0
+	};
+
+	//a compact vertex is smaller, so writing vertex i never overwrites one that has not been read yet
+	CompactPathVertex *out = (CompactPathVertex *)tp->vertices;
+	for(int c=0; c<tp->chunk_count; c++){
+		int first = c*PATH_CHUNK_VERTICES;
+		int last = first + PATH_CHUNK_VERTICES < tp->vertex_count ? first + PATH_CHUNK_VERTICES : tp->vertex_count;
+
+		Vector3 lo = tp->vertices[first].position, hi = lo;
+		for(int i=first; i<last; i++){
+			lo = Vector3Min(lo, tp->vertices[i].position);
+			hi = Vector3Max(hi, tp->vertices[i].position);
+		}
+		Vector3 step = Vector3Scale(Vector3Subtract(hi, lo), 1.0f/65535.0f);
+		Vector3 inv = {step.x > 0 ? 1.0f/step.x : 0, step.y > 0 ? 1.0f/step.y : 0, step.z > 0 ? 1.0f/step.z : 0};
+		tp->chunks[c] = (PathChunk){lo, step};
+
+		for(int i=first; i<last; i++){
+			PathVertex v = tp->vertices[i];
+			int p = 0;
+			while(!color_equal(colors[p], v.color)) p++;
+			CompactPathVertex q = {
+				(unsigned short)((v.position.x - lo.x)*inv.x + 0.5f),
+				(unsigned short)((v.position.y - lo.y)*inv.y + 0.5f),
+				(unsigned short)((v.position.z - lo.z)*inv.z + 0.5f),
+				(unsigned short)p,
+				(unsigned char)((v.values.x - v_lo.x)*v_inv.x + 0.5f),
+				(unsigned char)((v.values.y - v_lo.y)*v_inv.y + 0.5f),
+				(unsigned char)((v.values.z - v_lo.z)*v_inv.z + 0.5f),
+				(unsigned char)((v.values.w - v_lo.w)*v_inv.w + 0.5f)
+			};
+			memcpy(&out[i], &q, sizeof(q));	//the buffer is still typed as PathVertex
+		}
+	}
+
+	tp->vertices = (PathVertex *)realloc(tp->vertices, sizeof(CompactPathVertex)*(tp->vertex_count + 1));
+	tp->vertex_cap = 0;	//nothing gets added after this
+	if(tp->vertices == NULL){
+		perror("Could not shrink the path vertices!");
+		exit(-1);
+	}
+	return true;
+}
+
+//lines a segment is drawn with, arcs go in even steps of at most ARC_STEP so the last one ends on the end point
+static int toolpath_segment_lines(Segment *s){
+	return s->arc ? (int)ceilf(fabsf(s->angle)/ARC_STEP) : 1;
+}
+
+//the lines that draw the move ending at segment n
+static void toolpath_tessellate_segment(Toolpath *tp, int n){
+	Segment *s = &tp->path[n];
+	float order = (float)(tp->segment_base + n);	//added in 64 bits, out of core programs can go past an int
+	tp->time = tp->times ? tp->times[n] : tp->time + move_seconds(tp->path, n);
+	if(!s->arc){
+		toolpath_add_line(tp, tp->path[n-1].point, s->point, s, order);
+	}
+	else{
+		int steps = toolpath_segment_lines(s);
+		float start = arc_start(s), step = s->angle/steps;
+		for(int i=0; i<steps; i++)
+			toolpath_add_line(tp, arc_point(s, start + i*step), arc_point(s, start + (i + 1)*step), s, order);
+	}
+
+	float values[COLOR_MODES] = { [COLOR_BY_FEED] = s->feed, [COLOR_BY_SPINDLE] = s->spindle, [COLOR_BY_ORDER] = order, [COLOR_BY_TIME] = tp->time, [COLOR_BY_Z] = s->point.z };
+	for(int m=COLOR_BY_FEED; m<COLOR_MODES; m++){
+		if(m == COLOR_BY_FEED && s->type == 0) continue;	//rapids do not move at the feed rate
+		tp->value_min[m] = fminf(tp->value_min[m], values[m]);
+		tp->value_max[m] = fmaxf(tp->value_max[m], values[m]);
+	}
+}
+
+static void toolpath_reset_values(Toolpath *tp){
+	for(int m=0; m<COLOR_MODES; m++){
+		tp->value_min[m] = INFINITY;
+		tp->value_max[m] = -INFINITY;
+	}
+}
+
+//turn the segments into a line list and index it by layer and motion type, this can run on any thread
+void toolpath_tessellate(Toolpath *tp){
+	Segment *seg = tp->path;
+	tp->vertex_count = 0;
+	tp->run_count = 0;
+	tp->time = tp->time_base;
+	toolpath_reset_values(tp);
+
+	toolpath_find_layers(tp);
+
+	for(int n=1; n<tp->len; n++){
+		int first = tp->vertex_count;
+		toolpath_tessellate_segment(tp, n);
+		toolpath_add_run(tp, first, tp->vertex_count - first, toolpath_layer(tp, seg[n].point.z), seg[n].type);
+	}
+
+	if(tp->compact) tp->compact = toolpath_compress(tp);
+
+	tp->draw_first = (int *)malloc(sizeof(int)*(tp->run_count + 1));
+	tp->draw_count = (int *)malloc(sizeof(int)*(tp->run_count + 1));
+	if(tp->draw_first == NULL || tp->draw_count == NULL){
+		perror("Could not allocate space for the layer index!");
+		exit(-1);
+	}
+}
+
+//pick the vertex ranges to draw from the index, the vertex data itself is never touched
+void toolpath_filter(Toolpath *tp, PathFilter *f){
+	tp->filter = *f;
+	int l0 = toolpath_layer(tp, f->z_min);
+	int l1 = toolpath_layer(tp, f->z_max);
+	if(tp->layer_count > 0 && tp->layers[l0] < f->z_min - LAYER_TOLERANCE) l0++;	//z_min is above that layer
+	if(tp->layer_count > 0 && tp->layers[l1] > f->z_max + LAYER_TOLERANCE) l1--;	//z_max is below every layer
+
+	tp->draw_ranges = 0;
+	tp->filtered = false;
+	for(int i=0; i<tp->run_count; i++){
+		PathRun *r = &tp->runs[i];
+		if(r->layer < l0 || r->layer > l1 || !(f->types & (1 << r->type))){
+			tp->filtered = true;
+			continue;
+		}
+
+		int last = tp->draw_ranges - 1;
+		if(last >= 0 && tp->draw_first[last] + tp->draw_count[last] == r->first){
+			tp->draw_count[last] += r->count;
+		}
+		else{
+			tp->draw_first[tp->draw_ranges] = r->first;
+			tp->draw_count[tp->draw_ranges] = r->count;
+			tp->draw_ranges++;
+		}
+	}
+}
+
+static int toolpath_vertex_size(Toolpath *tp){
+	return tp->compact ? sizeof(CompactPathVertex) : sizeof(PathVertex);
+}
+
+//the values go in the normal attribute, raylib only binds its own attribute names to fixed locations
+static void toolpath_set_attributes(Toolpath *tp){
+	if(tp->compact){	//the compact shader reads the color from the palette
+		rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 4, GL_UNSIGNED_SHORT, false, sizeof(CompactPathVertex), 0);
+		rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+		rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, 4, RL_UNSIGNED_BYTE, false, sizeof(CompactPathVertex), offsetof(CompactPathVertex, feed));
+		rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL);
+		rlDisableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR);
+		return;
+	}
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 3, RL_FLOAT, false, sizeof(PathVertex), 0);
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, 4, RL_UNSIGNED_BYTE, true, sizeof(PathVertex), offsetof(PathVertex, color));
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR);
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, 4, RL_FLOAT, false, sizeof(PathVertex), offsetof(PathVertex, values));
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL);
+}
+
+//move the tessellated lines to the gpu, needs the gl context so it has to run on the main thread
+void toolpath_upload(Toolpath *tp){
+	tp->vao = rlLoadVertexArray();
+	rlEnableVertexArray(tp->vao);
+	tp->vbo = rlLoadVertexBuffer(tp->vertices, toolpath_vertex_size(tp)*tp->vertex_count, false);
+	toolpath_set_attributes(tp);
+	rlDisableVertexArray();
+
+	free(tp->vertices);
+	tp->vertices = NULL;
+	tp->vertex_cap = 0;
+}
+
+//upload into buffers owned by the caller and reused from path to path, they only grow when a path does not fit,
+//cap is in bytes since paths that did not fit the compact format can come between compact ones
+void toolpath_upload_shared(Toolpath *tp, unsigned int *vao, unsigned int *vbo, int *cap){
+	int size = toolpath_vertex_size(tp)*tp->vertex_count;
+	if(size > *cap){
+		if(*vao) rlUnloadVertexArray(*vao);
+		if(*vbo) rlUnloadVertexBuffer(*vbo);
+		*cap = size + size/2;
+		*vao = rlLoadVertexArray();
+		rlEnableVertexArray(*vao);
+		*vbo = rlLoadVertexBuffer(NULL, *cap, true);
+		rlDisableVertexArray();
+	}
+	rlUpdateVertexBuffer(*vbo, tp->vertices, size, 0);
+	rlEnableVertexArray(*vao);
+	rlEnableVertexBuffer(*vbo);
+	toolpath_set_attributes(tp);
+	rlDisableVertexArray();
+
+	tp->vao = *vao;
+	tp->vbo = *vbo;
+	free(tp->vertices);
+	tp->vertices = NULL;
+	tp->vertex_cap = 0;
+}
+
+//add the moves from segment `from` on to the end of the gpu buffer of a path that is still being read,
+//when the buffer is full it is replaced by one twice the size and everything is tessellated again
+void toolpath_append(Toolpath *tp, int from){
+	int gpu_count = tp->vertex_count;
+	tp->vertex_count = 0;	//the cpu array only holds what is new
+	if(gpu_count == 0){
+		toolpath_reset_values(tp);
+		tp->time = 0;
+	}
+	for(int n = from > 1 ? from : 1; n<tp->len; n++) toolpath_tessellate_segment(tp, n);
+	int added = tp->vertex_count;
+
+	if(gpu_count + added <= tp->gpu_cap){
+		if(added > 0) rlUpdateVertexBuffer(tp->vbo, tp->vertices, sizeof(PathVertex)*added, sizeof(PathVertex)*gpu_count);
+		tp->vertex_count = gpu_count + added;
+		return;
+	}
+
+	tp->vertex_count = 0;
+	tp->time = 0;
+	for(int n=1; n<tp->len; n++) toolpath_tessellate_segment(tp, n);
+	tp->gpu_cap = tp->vertex_count*2 > 65536 ? tp->vertex_count*2 : 65536;
+
+	if(tp->vao) rlUnloadVertexArray(tp->vao);
+	if(tp->vbo) rlUnloadVertexBuffer(tp->vbo);
+	tp->vao = rlLoadVertexArray();
+	rlEnableVertexArray(tp->vao);
+	tp->vbo = rlLoadVertexBuffer(NULL, sizeof(PathVertex)*tp->gpu_cap, true);
+	rlUpdateVertexBuffer(tp->vbo, tp->vertices, sizeof(PathVertex)*tp->vertex_count, 0);
+	toolpath_set_attributes(tp);
+	rlDisableVertexArray();
+}
+
+//extent of the path including the full width of its arcs
+BoundingBox toolpath_bounds(Toolpath *tp){
+	BoundingBox box = {{0, 0, 0}, {0, 0, 0}};
+	for(int n=0; n<tp->len; n++){
+		Segment *s = &tp->path[n];
+		box.min = Vector3Min(box.min, s->point);
+		box.max = Vector3Max(box.max, s->point);
+		if(s->arc){
+			Vector3 r = {s->radius, s->radius, 0};
+			box.min = Vector3Min(box.min, Vector3Subtract(s->center, r));
+			box.max = Vector3Max(box.max, Vector3Add(s->center, r));
+		}
+	}
+	return box;
+}
+
+//both vertex formats share path.fs, the compact one decodes its vertices in path_compact.vs
+void load_path_shaders(int glsl_version){
+	for(int compact=0; compact<2; compact++){
+		PathShader *ps = &path_shaders[compact];
+		ps->shader = LoadShader(TextFormat("resources/shaders/glsl%i/%s", glsl_version, compact ? "path_compact.vs" : "path.vs"),
+				TextFormat("resources/shaders/glsl%i/path.fs", glsl_version));
+		ps->tint_loc = GetShaderLocation(ps->shader, "tint");
+		ps->tint_amount_loc = GetShaderLocation(ps->shader, "tintAmount");
+		ps->origin_loc = GetShaderLocation(ps->shader, "chunkOrigin");
+		ps->step_loc = GetShaderLocation(ps->shader, "chunkStep");
+		ps->palette_loc = GetShaderLocation(ps->shader, "palette");
+		ps->values_origin_loc = GetShaderLocation(ps->shader, "valuesOrigin");
+		ps->values_step_loc = GetShaderLocation(ps->shader, "valuesStep");
+		ps->color_by_value_loc = GetShaderLocation(ps->shader, "colorByValue");
+		ps->value_select_loc = GetShaderLocation(ps->shader, "valueSelect");
+		ps->z_select_loc = GetShaderLocation(ps->shader, "zSelect");
+		ps->value_range_loc = GetShaderLocation(ps->shader, "valueRange");
+		ps->colormap_loc = GetShaderLocation(ps->shader, "colormap");
+	}
+}
+
+void unload_path_shaders(void){
+	for(int compact=0; compact<2; compact++) UnloadShader(path_shaders[compact].shader);
+}
+
+//one draw call per range, compact paths also split them where the quantization box changes
+static void toolpath_draw_range(Toolpath *tp, PathShader *ps, int *chunk, int first, int count){
+	while(count > 0){
+		int n = count;
+		if(tp->compact){
+			int c = first / PATH_CHUNK_VERTICES;
+			if(c != *chunk){
+				*chunk = c;
+				rlSetUniform(ps->origin_loc, &tp->chunks[c].origin, SHADER_UNIFORM_VEC3, 1);
+				rlSetUniform(ps->step_loc, &tp->chunks[c].step, SHADER_UNIFORM_VEC3, 1);
+			}
+			int end = (c + 1)*PATH_CHUNK_VERTICES;
+			if(first + n > end) n = end - first;
+		}
+		glDrawArrays(GL_LINES, first, n);
+		profile_count_draw(n);
+		first += n;
+		count -= n;
+	}
+}
+
+//pick the value and the colormap in the shader, nothing about the vertices changes
+static void toolpath_set_coloring(Toolpath *tp, PathShader *ps, PathColoring *c){
+	int mode = c ? c->mode : COLOR_BY_TYPE;
+	float by_value = mode != COLOR_BY_TYPE;
+	Vector4 select = {mode == COLOR_BY_FEED, mode == COLOR_BY_SPINDLE, mode == COLOR_BY_ORDER, mode == COLOR_BY_TIME};
+	float z_select = mode == COLOR_BY_Z;
+	rlSetUniform(ps->color_by_value_loc, &by_value, SHADER_UNIFORM_FLOAT, 1);
+	rlSetUniform(ps->value_select_loc, &select, SHADER_UNIFORM_VEC4, 1);
+	rlSetUniform(ps->z_select_loc, &z_select, SHADER_UNIFORM_FLOAT, 1);
+	if(tp->compact){
+		rlSetUniform(ps->values_origin_loc, &tp->values_origin, SHADER_UNIFORM_VEC4, 1);
+		rlSetUniform(ps->values_step_loc, &tp->values_step, SHADER_UNIFORM_VEC4, 1);
+	}
+	if(mode == COLOR_BY_TYPE) return;
+
+	Vector2 range = {c->min, c->max};
+	if(mode == COLOR_BY_ORDER) range = (Vector2){0, (float)((tp->segment_total ? tp->segment_total : (int64_t)tp->len) - 1)};
+	Vector3 stops[COLORMAP_STOPS];
+	colormap_uniform(c->colormap, stops);
+	rlSetUniform(ps->value_range_loc, &range, SHADER_UNIFORM_VEC2, 1);
+	rlSetUniform(ps->colormap_loc, stops, SHADER_UNIFORM_VEC3, COLORMAP_STOPS);
+}
+
+//set up the path shader and buffers, the vertices are then drawn with toolpath_draw_vertices
+static PathShader *toolpath_begin_draw(Toolpath *tp, float tint_amount, PathColoring *coloring){
+	rlDrawRenderBatchActive();	//anything drawn in immediate mode so far has to go out first
+	profile_count_flush(true);
+
+	PathShader *ps = &path_shaders[tp->compact];
+	Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+	Vector4 tint = ColorNormalize(tp->color);
+
+	rlEnableShader(ps->shader.id);
+	rlSetUniformMatrix(ps->shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+	rlSetUniform(ps->tint_loc, &tint, SHADER_UNIFORM_VEC4, 1);
+	rlSetUniform(ps->tint_amount_loc, &tint_amount, SHADER_UNIFORM_FLOAT, 1);
+	if(tp->compact) rlSetUniform(ps->palette_loc, tp->palette, SHADER_UNIFORM_VEC4, tp->palette_count);
+	toolpath_set_coloring(tp, ps, coloring);
+
+	if(!rlEnableVertexArray(tp->vao)){	//no vertex array objects on this platform
+		rlEnableVertexBuffer(tp->vbo);
+		toolpath_set_attributes(tp);
+	}
+	return ps;
+}
+
+//the vertices in [first, first + count) that the filter lets through
+static void toolpath_draw_vertices(Toolpath *tp, PathShader *ps, int *chunk, int first, int count){
+	if(!tp->filtered){
+		toolpath_draw_range(tp, ps, chunk, first, count);
+		return;
+	}
+	for(int i=0; i<tp->draw_ranges; i++){
+		int a = tp->draw_first[i] > first ? tp->draw_first[i] : first;
+		int b = tp->draw_first[i] + tp->draw_count[i] < first + count ? tp->draw_first[i] + tp->draw_count[i] : first + count;
+		if(b > a) toolpath_draw_range(tp, ps, chunk, a, b - a);
+	}
+}
+
+static void toolpath_end_draw(void){
+	rlDisableVertexArray();
+	rlDisableVertexBuffer();
+	rlDisableShader();
+}
+
+//draw the whole path with the path shader, tint_amount blends the move colors towards the file color,
+//coloring picks what the moves are colored by, NULL colors them by type
+void DrawToolpath(Toolpath *tp, float tint_amount, PathColoring *coloring){
+	if(!tp->visible || tp->vertex_count == 0) return;
+
+	PathShader *ps = toolpath_begin_draw(tp, tint_amount, coloring);
+	int chunk = -1;
+	toolpath_draw_vertices(tp, ps, &chunk, 0, tp->vertex_count);
+	toolpath_end_draw();
+}
+
+void toolpath_free(Toolpath *tp){
+	if(tp->vao) rlUnloadVertexArray(tp->vao);
+	if(tp->vbo) rlUnloadVertexBuffer(tp->vbo);
+	free(tp->vertices);
+	free(tp->chunks);
+	free(tp->path);
+	free(tp->times);
+	free(tp->layers);
+	free(tp->runs);
+	free(tp->draw_first);
+	free(tp->draw_count);
+	line_index_free(&tp->lines);
+}
+
+#endif //TOOLPATH_H
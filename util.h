@@ -8,6 +8,12 @@ typedef struct {
 	bool show_model;
 	bool camera_ortho;
 	bool dark_mode;
+	bool color_by_file;
+	bool show_filter;
+	bool show_profiler;
+	bool show_model_info;	//what the stl check found
+	int color_mode;	//what the paths are colored by, COLOR_BY_*
+	int colormap;
 } Settings_t;
 
 //quake inverse square root, credit goes to ID Software I guess
@@ -151,6 +157,14 @@ void CheckInputs(Settings_t *s)
 	if(IsKeyPressed(KEY_M)) s->show_model = !s->show_model;
 	if(IsKeyPressed(KEY_C)) s->camera_ortho = !s->camera_ortho;
 	if(IsKeyPressed(KEY_D)) s->dark_mode = !s->dark_mode;
+	if(IsKeyPressed(KEY_F)) s->color_by_file = !s->color_by_file;
+	if(IsKeyPressed(KEY_L)) s->show_filter = !s->show_filter;
+	if(IsKeyPressed(KEY_P)) s->show_profiler = !s->show_profiler;
+	if(IsKeyPressed(KEY_I)) s->show_model_info = !s->show_model_info;
+	if(IsKeyPressed(KEY_V)){
+		if(IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT)) s->colormap = (s->colormap + 1) % COLORMAP_COUNT;
+		else s->color_mode = (s->color_mode + 1) % COLOR_MODES;
+	}
 }
 
 //this draws the grid in the xy plane
@@ -164,7 +178,8 @@ void DrawXYGrid(Settings_t *s){
 			major_shade = 0.2;
 		}
 
-    rlCheckRenderBatchLimit((half + 2)*4);
+    profile_count_flush(rlCheckRenderBatchLimit((2*half + 1)*4));
+    profile_count_vertices((2*half + 1)*4);
 
     rlBegin(RL_LINES);
         for (int i = -half; i <= half; i++)
@@ -193,37 +208,6 @@ void DrawXYGrid(Settings_t *s){
         }
     rlEnd();
 }
-// Draw a circle in 3D world space
-void DrawCircleSector3D(Vector3 center, float radius, float rotationAngle, float offsetAngle, float k, Color color)
-{
-    rlCheckRenderBatchLimit(2*36);
-
-    rlPushMatrix();
-        rlTranslatef(center.x, center.y, center.z);
-        //rlRotatef(DEG2RAD*45.0f, rotationAxis.x, rotationAxis.y, rotationAxis.z);
-
-        rlBegin(RL_LINES);
-					if(rotationAngle >= 0){
-            for (int i = -offsetAngle; i < rotationAngle-offsetAngle; i += 5)
-            {
-                rlColor4ub(color.r, color.g, color.b, color.a);
-
-                rlVertex3f(sinf(DEG2RAD*i)*radius, -cosf(DEG2RAD*i)*radius, (i + offsetAngle)*k/360.0);
-                rlVertex3f(sinf(DEG2RAD*(i+5))*radius, -cosf(DEG2RAD*(i+5))*radius, (i+5 + offsetAngle)*k/360.0);
-            }
-					}
-					else{
-            for (int i = offsetAngle; i > rotationAngle+offsetAngle; i -= 5)
-            {
-                rlColor4ub(color.r, color.g, color.b, color.a);
-
-                rlVertex3f(sinf(DEG2RAD*(i-5))*radius, -cosf(DEG2RAD*(i-5))*radius, (i-5 + offsetAngle)*k/360.0);
-                rlVertex3f(sinf(DEG2RAD*i)*radius, -cosf(DEG2RAD*i)*radius, (i + offsetAngle)*k/360.0);
-            }
-					}
-        rlEnd();
-    rlPopMatrix();
-}
 
 
 void printVector3(char* name, Vector3 v){
@@ -239,5 +223,6 @@ void DrawOrigin(){
 		DrawLine3D(origin, x, RED);
 		DrawLine3D(origin, y, GREEN);
 		DrawLine3D(origin, z, BLUE);
+		profile_count_vertices(6);
 }
 